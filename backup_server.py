@@ -16,13 +16,36 @@ import re
 import atexit
 import logging
 import time
-from datetime import datetime
-from flask import Flask, render_template, request, jsonify, Response, stream_with_context
+import signal
+import random
+import bisect
+import fnmatch
+import glob
+from collections import OrderedDict, deque
+from datetime import datetime, timedelta, timezone
+from flask import Flask, render_template, request, jsonify, Response, stream_with_context, send_from_directory
 from flask_socketio import SocketIO
 from urllib.parse import quote
 from werkzeug.utils import secure_filename
 import io
 import zipfile
+import gzip
+import tarfile
+import sqlite3
+import stat
+import errno
+import tempfile
+import hashlib
+import mimetypes
+import hmac
+import struct
+import resource
+import queue
+import secrets
+import http.client
+import xml.etree.ElementTree as ET
+from concurrent.futures import ThreadPoolExecutor
+from urllib.parse import urlsplit
 
 try:
     import qrcode
@@ -30,6 +53,11 @@ try:
 except ImportError:
     QRCODE_PY_AVAILABLE = False
 
+try: import zstandard
+except ImportError: zstandard = None
+try: import brotli
+except ImportError: brotli = None
+
 # --- Debug Configuration ---
 DEBUG_MODE = True
 
@@ -41,6 +69,14 @@ class TermColors:
 ROOT_NODE_CACHE = None
 ROOT_NODE_CACHE_TIME = 0
 print_lock = threading.Lock()
+FILE_INDEX_LOCK = threading.Lock()
+DIR_CACHE = OrderedDict(); DIR_CACHE_LOCK = threading.Lock()  # path -> (mtime_ns, tree nodes), LRU
+PROFILES_LOCK = threading.Lock()
+WARM_PLANS = {}  # profile name -> latest plan_backup() result
+SIZE_INDEX = {}  # selection_key -> (time, bytes, {ext: [files, bytes]}), fed by plans so pipelines can skip the size scan
+RESPONSE_CACHE = OrderedDict(); RESPONSE_CACHE_LOCK = threading.Lock()  # (etag, encoding) -> body, LRU
+SELECTIONS = OrderedDict(); SELECTIONS_LOCK = threading.Lock()  # selection token -> normalized include/exclude lists
+ASSET_BUNDLE = None; ASSET_LOCK = threading.Lock()  # {'key', 'css', 'js'} of the current fingerprinted build
 
 # --- Configuration ---
 HOST = '0.0.0.0'; PORT = 8000
@@ -52,10 +88,104 @@ SHARED_STORAGE_PATH = os.path.join(HOME_DIR, "storage", "shared")
 STDBUF_BIN = "/data/data/com.termux/files/usr/bin/stdbuf"; CAT_BIN = "/data/data/com.termux/files/usr/bin/cat"
 TAR_BIN = "/data/data/com.termux/files/usr/bin/tar"; ZSTD_BIN = "/data/data/com.termux/files/usr/bin/zstd"
 GPG_BIN = "/data/data/com.termux/files/usr/bin/gpg"; AGE_BIN = "/data/data/com.termux/files/usr/bin/age"
-PV_BIN = "/data/data/com.termux/files/usr/bin/pv"; DU_BIN = "/data/data/com.termux/files/usr/bin/du"
+DU_BIN = "/data/data/com.termux/files/usr/bin/du"
 WAKELOCK_BIN = "/data/data/com.termux/files/usr/bin/termux-wake-lock"
 WAKEUNLOCK_BIN = "/data/data/com.termux/files/usr/bin/termux-wake-unlock"
 
+# S3-compatible object storage (AWS, MinIO, Garage...). Credentials come from the environment only.
+# Endpoint and bucket are server settings too: requests are signed with these keys, so a client must not pick the host.
+S3_ENDPOINT = os.getenv("BACKUP_S3_ENDPOINT", ""); S3_BUCKET = os.getenv("BACKUP_S3_BUCKET", "")
+S3_REGION = os.getenv("BACKUP_S3_REGION", "us-east-1")
+S3_ACCESS_KEY = os.getenv("BACKUP_S3_ACCESS_KEY", ""); S3_SECRET_KEY = os.getenv("BACKUP_S3_SECRET_KEY", "")
+S3_PART_SIZE = 8 * 1024 * 1024; S3_PARTS_IN_FLIGHT = 4; S3_PART_RETRIES = 5
+# SFTP push: keys come from ~/.ssh (BatchMode), 64 x 64 KiB writes in flight = 4 MiB window.
+SSH_BIN = "/data/data/com.termux/files/usr/bin/ssh"
+SFTP_WRITE_SIZE = 64 * 1024; SFTP_MAX_REQUESTS = 64; SFTP_RECONNECTS = 3
+# Device-to-device transfer between two instances on the same LAN.
+PEER_PORT = PORT + 1; PEER_STREAMS = 4; PEER_CHUNK_SIZE = 1024 * 1024; PEER_REORDER_WINDOW = 16
+PEER_PROBE_BYTES = 4 * 1024 * 1024; PEER_PAIRING_TIMEOUT = 600
+# A receiver unpacks into its own targetDir (default below), never into a path the sender names.
+PEER_RECEIVE_PATH = os.path.join(BACKUPS_PATH, "received")
+# Delta restore: files at least this large are patched block-by-block instead of rewritten.
+DELTA_BLOCK_SIZE = 128 * 1024; DELTA_MIN_SIZE = 1024 * 1024
+# Catalog of archive manifests; incremental backups keep per-block hashes for large files.
+CATALOG_PATH = os.path.join(BACKUPS_PATH, ".catalog"); CATALOG_DB = os.path.join(CATALOG_PATH, "catalog.db")
+BLOCK_MAP_SIZE = 1024 * 1024; BLOCK_DELTA_MIN_SIZE = 32 * 1024 * 1024
+BLOCKS_PREFIX = ".termux-backup/blocks/"
+# Synthetic fulls: the archive is a run of independent zstd frames, cut before an entry once SYNTH_FRAME_SIZE of
+# tar has collected (big files start their own and are split every 2x that). Frames whose entries are all unchanged since the last
+# framed archive of the same sources are copied from it verbatim instead of being re-read and recompressed.
+SYNTH_FRAME_SIZE = 4 * 1024 * 1024; SYNTH_FRAME_WORKERS = min(os.cpu_count() or 1, 4); ZSTD_MAGIC = b"\x28\xb5\x2f\xfd"
+# Snapshot mode: each file is copied to staging first and archived once from a copy taken while it did not
+# change (up to SNAPSHOT_RETRIES tries), so no torn member ever reaches the stream.
+STAGING_PATH = os.path.join(BACKUPS_PATH, ".staging"); SNAPSHOT_RETRIES = 3
+SQLITE_MAGIC = b"SQLite format 3\x00"; SQLITE_SIDECARS = ("-wal", "-shm", "-journal")
+# One JSON record per skipped/failed entry, written while the job runs.
+REPORTS_PATH = os.path.join(BACKUPS_PATH, ".reports")
+# Single files restored from the version browser land here unless restored in place.
+RESTORED_PATH = os.path.join(BACKUPS_PATH, "restored"); VERSION_SEARCH_PATHS = 50
+# Symlinks below a selected root: 'store' keeps them as links, 'within' follows only links whose target lies under a
+# selected root but is not archived at its real path (excluded there), 'follow' also follows links leaving the selection.
+# Selected roots are always dereferenced; loops are never followed and every target, file or directory, is archived once.
+SYMLINK_POLICIES = ('store', 'within', 'follow')
+# Page cache: a job may leave at most PAGE_CACHE_BUDGET_MB of the files it read cached (cacheMode 'bounded');
+# the rest is dropped behind the reader, and local archives are flushed and dropped every PAGE_CACHE_FLUSH bytes.
+PAGE_CACHE_MODES = ('bounded', 'drop', 'keep'); PAGE_CACHE_BUDGET_MB = 256; PAGE_CACHE_FLUSH = 32 * 1024 * 1024
+# Output is moved in OUTPUT_BLOCK_SIZE blocks from a small pool of reused buffers; local archives are preallocated
+# from the plan's predicted size. durabilityMode: 'fast' never syncs, 'batch' syncs once when the job ends,
+# 'strict' also syncs every restored file and the archive's directory.
+OUTPUT_BLOCK_SIZE = 1024 * 1024; OUTPUT_BUFFERS = 4; DURABILITY_MODES = ('fast', 'batch', 'strict')
+# Stages get this long to exit after SIGTERM before their process group is SIGKILLed.
+ABORT_GRACE = 2.0
+# Idle zstd processes kept ready per recently used level, so a job starts without spawning.
+ZSTD_POOL_SIZE = 2; ZSTD_POOL_LEVELS = 3
+# Progress is sampled from job counters at a fixed rate (BACKUP_PROGRESS_HZ) and sent as one binary frame
+# per tick for all running jobs; live file names are batched, at most PROGRESS_FILE_NAMES per job and tick.
+PROGRESS_INTERVAL = 1 / max(float(os.getenv("BACKUP_PROGRESS_HZ", "2")), 0.1); PROGRESS_FILE_NAMES = 25
+# Dry-run planning: compress a few random 64 KiB slices of the selection to predict the ratio.
+PLAN_SAMPLES = 64; PLAN_SAMPLE_SIZE = 64 * 1024; PLAN_HISTORY = 20
+# ETA model: cost = per-file overhead + bytes x per-extension seconds/byte, learned after each backup
+# (EWMA weight ETA_LEARN_WEIGHT); a scalar Kalman filter tracks how fast the job runs against that model.
+ETA_LEARN_WEIGHT = 0.3; ETA_SMALL_FILE = 64 * 1024; ETA_MIN_LEARN_BYTES = 1024 * 1024; ETA_MAX_EXTENSIONS = 500
+ETA_PROCESS_NOISE = 0.02; ETA_MEASUREMENT_NOISE = 0.5
+# Job history dashboard: how many recent backups /api/job_history returns.
+JOB_HISTORY_LIMIT = 200
+# Compressibility estimator: the same sample compressed at each level in parallel (one thread each).
+ESTIMATE_LEVELS = (1, 3, 6, 9, 19); ESTIMATE_BUDGET = 3.0; ESTIMATE_CACHE_TTL = 600
+ESTIMATE_CACHE = {}
+# Filename index over the tree roots; directories whose mtime is unchanged are not re-listed.
+FILE_INDEX_DB = os.path.join(CATALOG_PATH, "files.db"); FILE_INDEX_INTERVAL = 15 * 60; FILE_SEARCH_LIMIT = 200
+# Tree listings are cached per directory and revalidated against its mtime.
+DIR_CACHE_MAX = 4096; TREE_BATCH_MAX_DEPTH = 3; TREE_BATCH_MAX_NODES = 5000
+# Tree selections are posted once and referenced by token; the most recent ones are kept in memory.
+SELECTION_TOKENS_MAX = 128
+# JSON responses: bodies of ETag'd responses are kept serialized (and compressed) per encoding.
+RESPONSE_CACHE_MAX = 256; COMPRESS_MIN_SIZE = 1024
+# Front-end assets: third-party files are vendored once (--fetch-assets) and bundled with ours into
+# content-hashed files under static/dist, served immutable with .gz/.br/.zst variants. Until then the
+# page loads them from the CDN and says so, since it will not work offline.
+STATIC_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "static")
+VENDOR_PATH = os.path.join(STATIC_PATH, "vendor"); DIST_PATH = os.path.join(STATIC_PATH, "dist")
+ASSET_MAX_AGE = 365 * 24 * 3600
+CDNJS = "https://cdnjs.cloudflare.com/ajax/libs"
+VENDOR_ASSETS = {  # vendor path -> source URL; relative url() references in the CSS must keep their layout
+    "font-awesome/css/all.min.css": f"{CDNJS}/font-awesome/6.4.2/css/all.min.css",
+    **{f"font-awesome/webfonts/{font}.{ext}": f"{CDNJS}/font-awesome/6.4.2/webfonts/{font}.{ext}"
+       for font in ("fa-solid-900", "fa-regular-400", "fa-brands-400", "fa-v4compatibility") for ext in ("woff2", "ttf")},
+    "jstree/themes/default-dark/style.min.css": f"{CDNJS}/jstree/3.3.15/themes/default-dark/style.min.css",
+    **{f"jstree/themes/default-dark/{img}": f"{CDNJS}/jstree/3.3.15/themes/default-dark/{img}" for img in ("32px.png", "40px.png", "throbber.gif")},
+    "jquery.min.js": f"{CDNJS}/jquery/3.7.1/jquery.min.js",
+    "jstree.min.js": f"{CDNJS}/jstree/3.3.15/jstree.min.js",
+    "socket.io.min.js": f"{CDNJS}/socket.io/4.7.2/socket.io.min.js",
+}
+# Bundle order matters: jstree needs jQuery, app.js needs all three.
+ASSET_CSS = ("vendor/font-awesome/css/all.min.css", "vendor/jstree/themes/default-dark/style.min.css", "style.css")
+ASSET_JS = ("vendor/jquery.min.js", "vendor/jstree.min.js", "vendor/socket.io.min.js", "app.js")
+# Named backup profiles; their plans are refreshed in the background and a daily schedule is optional.
+PROFILES_FILE = os.path.join(CATALOG_PATH, "profiles.json"); PROFILE_WARM_INTERVAL = 30 * 60; SCHEDULER_TICK = 30
+PROFILE_FIELDS = ('sources', 'excludes', 'compressionLevel', 'symlinkPolicy', 'cacheMode', 'durabilityMode', 'encrypt', 'encryptionMethod', 'gpgRecipient', 'errorHandling', 'backupType',
+                  'snapshotMode', 'sqliteBackup', 'destination', 's3Prefix', 'sftpTarget', 'sftpPort', 'peerAddress', 'schedule')
+
 app = Flask(__name__); app.config['SECRET_KEY'] = 'a_very_secret_key'
 socketio = SocketIO(app, async_mode='threading')
 
@@ -70,10 +200,68 @@ def log_event(message, level='info'):
     print(f"{prefix} {message}")
     socketio.emit('log_message', {'level': level, 'message': message})
 
-def monitor_process_stderr(process, stream_name, error_event=None, policy='ignore', failed_files_list=None, base_path=None):
+def report_file_processed(filename):
+    socketio.emit('file_processed', {'filename': filename})
+    depth = filename.count(os.sep)
+    indent = '  ' * depth
+    basename = os.path.basename(filename) or filename
+    with print_lock:
+        sys.stdout.write(f"{indent}✅ {basename}\n"); sys.stdout.flush()
+
+# --- Cancellation ---
+class CancelToken(threading.Event):
+    """Set-once abort flag shared by every stage of a job. Callbacks fire in the thread that
+    cancels, so the pipeline is torn down at once instead of when the next pipe read returns."""
+    def __init__(self):
+        super().__init__(); self.reason = None; self.cancelled_at = None; self.callbacks = []; self.lock = threading.Lock()
+
+    def on_cancel(self, callback):
+        with self.lock:
+            if not self.is_set(): self.callbacks.append(callback); return
+        callback(self)
+
+    def cancel(self, reason="Cancelled"):
+        with self.lock:
+            if self.is_set(): return
+            self.reason, self.cancelled_at = reason, time.monotonic(); super().set(); callbacks = self.callbacks
+        for callback in callbacks: callback(self)
+
+    def set(self): self.cancel(self.reason or "Cancelled")
+
+ACTIVE_JOBS = set()  # CancelTokens of running jobs, for /api/cancel_job
+
+def spawn_stage(cmd, **kwargs):
+    # Own process group, so an abort also reaches anything the stage forked. Stages that may
+    # prompt on the terminal (age/gpg) stay in ours and are signalled directly.
+    return subprocess.Popen(cmd, start_new_session=True, **kwargs)
+
+def signal_stage(proc, sig):
+    if not hasattr(proc, 'pid'):
+        proc.terminate(); return  # in-process engine: cooperative stop
+    if proc.poll() is not None: return
+    try:
+        if os.getpgid(proc.pid) == proc.pid: os.killpg(proc.pid, sig)
+        else: proc.send_signal(sig)
+    except (ProcessLookupError, PermissionError): pass
+
+def stop_stages(processes, grace=ABORT_GRACE):
+    for _, proc in processes: signal_stage(proc, signal.SIGTERM)
+    deadline = time.monotonic() + grace
+    for _, proc in processes:
+        if proc is threading.current_thread(): continue
+        if not hasattr(proc, 'pid'): proc.wait(max(deadline - time.monotonic(), 0)); continue
+        try: proc.wait(max(deadline - time.monotonic(), 0))
+        except subprocess.TimeoutExpired: signal_stage(proc, signal.SIGKILL); proc.wait()
+
+def abort_on_cancel(token, processes, label):
+    def teardown(token):
+        stop_stages(processes)
+        log_event(f"{label} aborted ({token.reason}); all stages stopped in {time.monotonic() - token.cancelled_at:.2f}s.", 'warn')
+    token.on_cancel(lambda token: threading.Thread(target=teardown, args=(token,), daemon=True).start())
+
+def monitor_process_stderr(process, stream_name, error_event=None, policy='ignore'):
     is_verbose_tar = (stream_name == 'tar' and any('v' in arg for arg in process.args))
     critical_errors = ["permission denied", "cannot open"]; ignorable_errors = ["broken pipe", "write error"]
-    tar_error_re = re.compile(r"tar: (.*?): Cannot (?:open|read|stat)")
 
     with process.stderr as pipe:
         for line in iter(pipe.readline, b''):
@@ -81,41 +269,1914 @@ def monitor_process_stderr(process, stream_name, error_event=None, policy='ignor
             if not line_str: continue
 
             if is_verbose_tar and not line_str.startswith("tar: "):
-                filename = line_str
-                socketio.emit('file_processed', {'filename': filename})
-                depth = filename.count(os.sep)
-                indent = '  ' * depth
-                basename = os.path.basename(filename) or filename
-                with print_lock:
-                    sys.stdout.write(f"{indent}✅ {basename}\n"); sys.stdout.flush()
-                continue
-
-            if stream_name == 'tar' and failed_files_list is not None and base_path:
-                if match := tar_error_re.match(line_str):
-                    failed_files_list.append(os.path.join(base_path, match.group(1).strip("'")))
-            
+                report_file_processed(line_str); continue
+
             if any(err in line_str.lower() for err in ignorable_errors): continue
             socketio.emit('log_message', {'level': 'stderr', 'message': f"[{stream_name}] {line_str}"})
 
             if error_event and policy == 'abort' and any(err in line_str.lower() for err in critical_errors):
                 log_event(f"Critical error in '{stream_name}': {line_str}. Aborting.", 'error')
-                error_event.set(); break
+                error_event.cancel(f"{stream_name}: {line_str}") if isinstance(error_event, CancelToken) else error_event.set(); break
 
-def monitor_pv_progress(pv_process):
-    percent_re, speed_re, eta_re = re.compile(r"(\d+\.?\d*)[%]"), re.compile(r"\[\s*(\d+\.?\d*\w+i?B/s)\s*\]"), re.compile(r"ETA\s+([\d:]+)")
-    with pv_process.stderr as pipe:
-        for line in iter(pipe.readline, b''):
-            line_str = line.decode('utf-8', errors='ignore')
-            percent, speed, eta = percent_re.search(line_str), speed_re.search(line_str), eta_re.search(line_str)
-            progress_data = {'percent': f"{float(percent.group(1)):.1f}" if percent else "0.0", 'speed': speed.group(1) if speed else "--", 'eta': eta.group(1) if eta else "--:--"}
-            if speed: socketio.emit('progress_update', progress_data)
+def format_rate(bytes_per_s):
+    for unit in ('B', 'KiB', 'MiB', 'GiB'):
+        if bytes_per_s < 1024 or unit == 'GiB': return f"{bytes_per_s:.1f}{unit}/s"
+        bytes_per_s /= 1024
+
+class ProgressHub:
+    """One sampler thread for every running job. Jobs only bump plain counters (bytes_written,
+    files_written, write_wait, recent_files); each tick packs the jobs whose counters moved into a
+    single binary `progress` frame, so the cost is per tick and per job, never per byte or file.
+
+    Frame: <BB version, count> then per job <HBQqIIfH>: id, state (0 running, 1 done, 2 failed),
+    bytes, total (-1 unknown), files, ETA seconds (0xFFFFFFFF unknown), EWMA rate (B/s) and the
+    share of the interval the engine spent blocked on the compressor, in permille.
+    """
+    HEADER = struct.Struct('<BB'); RECORD = struct.Struct('<HBQqIIfH'); UNKNOWN_ETA = 0xFFFFFFFF
+
+    def __init__(self):
+        self.jobs = {}; self.lock = threading.Lock(); self.next_id = 1; self.thread = None
+
+    def register(self, source, label):
+        with self.lock:
+            job_id = self.next_id; self.next_id = self.next_id % 0xFFFF + 1
+            self.jobs[job_id] = {'source': source, 'label': label, 'last': None, 'time': time.monotonic(), 'rate': 0.0, 'wait': 0.0}
+            if not self.thread or not self.thread.is_alive():
+                self.thread = threading.Thread(target=self._run, daemon=True); self.thread.start()
+        socketio.emit('progress_jobs', {'added': {job_id: label}}); return job_id
+
+    def _sample(self, job_id, job, now):
+        src = job['source']; done, files, total = src.bytes_written, src.files_written, src.total_size
+        alive = src.is_alive(); state = 0 if alive else (1 if src.returncode in (0, 1) else 2)
+        elapsed = max(now - job['time'], 1e-6); instant = (done - (job['last'] or (0,))[0]) / elapsed
+        job['rate'] = instant if not job['rate'] else 0.7 * job['rate'] + 0.3 * instant
+        wait = src.write_wait; blocked = min((wait - job['wait']) / elapsed, 1.0); job['wait'], job['time'] = wait, now
+        snapshot = (done, total, files, state)
+        if snapshot == job['last'] and alive: return None
+        job['last'] = snapshot
+        eta = src.eta.update(now, src.cost_done, src.total_cost) if state == 0 else 0
+        eta = int(eta) if eta is not None else self.UNKNOWN_ETA
+        return self.RECORD.pack(job_id, state, done, total if total is not None else -1, files, min(eta, self.UNKNOWN_ETA), job['rate'], int(blocked * 1000))
+
+    def _run(self):
+        while True:
+            time.sleep(PROGRESS_INTERVAL); now = time.monotonic()
+            with self.lock:
+                jobs = list(self.jobs.items())
+                if not jobs: self.thread = None; return  # under the lock, so register() starts a new sampler
+            records, finished, names = [], [], {}
+            for job_id, job in jobs:
+                record = self._sample(job_id, job, now)
+                if record: records.append(record)
+                if record and record[2] != 0: finished.append(job_id)
+                recent = job['source'].recent_files; batch = []
+                while recent and len(batch) < PROGRESS_FILE_NAMES: batch.append(recent.popleft())
+                if batch: names[job_id] = {'names': batch, 'more': bool(recent)}; recent.clear()
+            for i in range(0, len(records), 255):
+                chunk = records[i:i + 255]; socketio.emit('progress', self.HEADER.pack(1, len(chunk)) + b''.join(chunk))
+            if names: socketio.emit('files_processed', names)
+            if finished:
+                with self.lock:
+                    for job_id in finished: self.jobs.pop(job_id, None)
+                socketio.emit('progress_jobs', {'removed': finished})
+
+PROGRESS = ProgressHub()
+
+def measure_selection(writer, base, rel_sources):
+    # A metadata walk rather than `du`: the ETA model needs the per-extension mix, not just the bytes.
+    try:
+        totals, files = scan_selection(base, rel_sources, writer.excludes, writer.symlink_policy)
+        writer.total_cost = writer.eta_model.cost(selection_mix(totals, files)); writer.total_size = totals['bytes']
+    except Exception as e: log_event(f"Could not calculate total size (often OK): {e}", "warn")
+
+class WarmProcessPool:
+    """Idle `zstd -T0 -<level>` processes, spawned ahead of time for the levels used most recently.
+
+    A zstd process compresses exactly one stream, so processes are handed over rather than
+    reused; every acquire() queues a replacement in the background, off the job's start path.
+    """
+    def __init__(self, per_level=ZSTD_POOL_SIZE, max_levels=ZSTD_POOL_LEVELS):
+        self.per_level, self.max_levels = per_level, max_levels
+        self.idle = {}; self.levels = OrderedDict(); self.lock = threading.Lock()
+
+    def _spawn(self, level):
+        return spawn_stage([ZSTD_BIN, "-T0"] + ([f"-{level}"] if level else []), stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+    def acquire(self, level):
+        proc = None
+        with self.lock:
+            self.levels[level] = True; self.levels.move_to_end(level)
+            while len(self.levels) > self.max_levels:
+                old, _ = self.levels.popitem(last=False)
+                for idle in self.idle.pop(old, []): idle.kill(); idle.wait()
+            ready = self.idle.setdefault(level, [])
+            while ready and proc is None:
+                candidate = ready.pop()
+                if candidate.poll() is None: proc = candidate
+        threading.Thread(target=self.fill, args=(level,), daemon=True).start()
+        return proc or self._spawn(level)
+
+    def prewarm(self, level):
+        with self.lock: self.levels[level] = True
+        threading.Thread(target=self.fill, args=(level,), daemon=True).start()
+
+    def fill(self, level):
+        while True:
+            with self.lock:
+                if level not in self.levels or len(self.idle.get(level, [])) >= self.per_level: return
+            proc = self._spawn(level)
+            with self.lock:
+                if level in self.levels: self.idle.setdefault(level, []).append(proc); continue
+            proc.kill(); proc.wait(); return
+
+    def close(self):
+        with self.lock:
+            for procs in self.idle.values():
+                for proc in procs: proc.kill()
+            self.idle.clear(); self.levels.clear()
+
+ZSTD_POOL = WarmProcessPool()
+atexit.register(ZSTD_POOL.close)
+
+def parse_excludes(config):
+    raw = config.get('excludes') or []
+    if isinstance(raw, str): raw = re.split(r'[\n,]', raw)
+    return [p.strip().rstrip('/') for p in raw if p.strip()]
+
+def is_excluded(rel, patterns, path=None):
+    # A pattern matches either the whole relative path or any single name in it ("node_modules", "*.log");
+    # absolute patterns (from selection excludes) match the absolute path.
+    return any(fnmatch.fnmatch(path or rel, p) if p.startswith('/') else (fnmatch.fnmatch(rel, p) or fnmatch.fnmatch(os.path.basename(rel), p))
+               for p in patterns)
+
+def selection_key(pruned_sources, excludes): return json.dumps([sorted(pruned_sources), sorted(excludes)])
+
+def symlink_policy(config):
+    policy = config.get('symlinkPolicy') or 'within'
+    return policy if policy in SYMLINK_POLICIES else 'within'
+
+def path_within(path, roots): return any(path == root or path.startswith(root.rstrip(os.sep) + os.sep) for root in roots)
+
+def skipped_at_real_path(real, base, rel_sources, roots, excludes):
+    """Whether the walk of the selected roots left `real` out: excluded, or one of the server's own directories."""
+    for rel, root in zip(rel_sources, roots):
+        if not path_within(real, [root]): continue
+        parts = os.path.normpath(os.path.join(rel, os.path.relpath(real, root))).split(os.sep)
+        for depth in range(len(os.path.normpath(rel).split(os.sep)), len(parts) + 1):
+            sub = os.sep.join(parts[:depth]); path = os.path.join(base, sub)
+            if path in (CATALOG_PATH, STAGING_PATH, REPORTS_PATH) or (excludes and is_excluded(sub, excludes, path)): return True
+        return False
+    return False
+
+def classify_symlink(path, policy, roots, ancestors, followed, skipped=lambda real: False):
+    """What to do with a symlink met below a selected root, once the roots themselves are walked.
+    `followed` holds the (dev, ino) of everything already archived through a link; skipped(real) tells
+    whether the roots' walk left that real path out. Returns (action, reason, stat of the target):
+    action is 'link' (store the link itself) or 'follow'."""
+    if policy == 'store': return 'link', 'stored', None
+    try: real, st = os.path.realpath(path), os.stat(path)
+    except OSError: return 'link', 'dangling', None
+    key = (st.st_dev, st.st_ino)
+    if key in ancestors: return 'link', 'loop', st
+    if key in followed: return 'link', 'duplicate', st
+    if path_within(real, roots): return ('follow', 'followed', st) if skipped(real) else ('link', 'duplicate', st)
+    if policy == 'within': return 'link', 'outside', st
+    return 'follow', 'followed', st
+
+def compression_level(config): return min(max(int(config.get('compressionLevel') or 0), 0), 19)
+
+class PathTrie:
+    """Paths split into components in nested dicts; the None key of a node holds its mark
+    (True = include, False = exclude). normalize() is one walk over the trie, so thousands of
+    selected nodes cost linear time instead of a pairwise prefix scan."""
+    def __init__(self): self.root = {}
+
+    def add(self, path, mark=True):
+        node = self.root
+        for part in path.split(os.sep):
+            if part: node = node.setdefault(part, {})
+        node[None] = mark
+
+    def normalize(self):
+        # Marks that repeat their parent's effective state are redundant; only state changes are kept.
+        include, exclude = [], []; stack = [(self.root, '', False)]
+        while stack:
+            node, path, inherited = stack.pop(); state = node.get(None, inherited)
+            if state != inherited: (include if state else exclude).append(path or os.sep)
+            stack.extend((child, f"{path}{os.sep}{part}", state) for part, child in node.items() if part is not None)
+        return sorted(include), sorted(exclude)
 
 def prune_redundant_paths(paths):
+    # Compared by real path: ~/storage/shared and /storage/emulated/0 are the same tree.
     if not paths: return []
-    sorted_paths = sorted(list(set(os.path.abspath(p) for p in paths)))
-    return [p for i, p in enumerate(sorted_paths) if not any(p.startswith(parent + os.sep) for parent in sorted_paths[:i])]
+    by_real = {}; trie = PathTrie()
+    for p in sorted(set(os.path.abspath(p) for p in paths)):
+        real = os.path.realpath(p); trie.add(real)
+        if real == p or real not in by_real: by_real[real] = p  # prefer the real path over a link to it
+    return sorted(by_real[r] for r in trie.normalize()[0])
+
+def normalize_selection(include, exclude):
+    """Minimal include/exclude lists for a jsTree selection: includes below an include and
+    excludes outside any include are dropped, an exclude re-included further down is kept."""
+    trie = PathTrie()
+    for path in exclude: trie.add(os.path.abspath(path), False)
+    for path in include: trie.add(os.path.abspath(path), True)  # an explicit include beats an exclude of the same path
+    return trie.normalize()
+
+def create_selection(include, exclude):
+    include, exclude = normalize_selection(include, exclude)
+    if not include: raise ValueError("No source files or folders selected.")
+    token = hashlib.blake2b(json.dumps([include, exclude]).encode(), digest_size=12).hexdigest()
+    with SELECTIONS_LOCK:
+        SELECTIONS[token] = {'include': include, 'exclude': exclude}; SELECTIONS.move_to_end(token)
+        while len(SELECTIONS) > SELECTION_TOKENS_MAX: SELECTIONS.popitem(last=False)
+    return token, include, exclude
+
+def expand_excludes(include, exclude):
+    """The walk skips an excluded directory whole, so an exclude with includes below it becomes
+    excludes of its other children, one level at a time down to each re-included path."""
+    expanded, pending = [], list(exclude)
+    while pending:
+        path = pending.pop(); below = [p for p in include if p.startswith(path.rstrip(os.sep) + os.sep)]
+        if not below: expanded.append(path); continue
+        try: names = os.listdir(path)
+        except OSError: continue  # unreadable: nothing under it gets archived anyway
+        for name in names:
+            child = os.path.join(path, name)
+            if child in include: continue
+            if any(p.startswith(child + os.sep) for p in below): pending.append(child)
+            else: expanded.append(child)
+    return expanded
+
+def resolve_selection(config):
+    """Replace a config's selection token with the sources and absolute excludes it stands for."""
+    token = config.get('selection')
+    if not token: return config
+    with SELECTIONS_LOCK: selection = SELECTIONS.get(token)
+    if selection is None: raise ValueError("The file selection has expired; please start the job again.")
+    excludes = parse_excludes(config) + [glob.escape(path) for path in expand_excludes(selection['include'], selection['exclude'])]
+    return {**config, 'sources': selection['include'], 'excludes': excludes}
+
+# --- Remote Destinations ---
+class S3MultipartUpload:
+    """Write-only file object that streams into an S3 multipart upload.
+
+    Parts are cut from the incoming stream and uploaded by a small thread pool; at most
+    S3_PARTS_IN_FLIGHT parts (plus the one being filled) are held in memory at any time,
+    so nothing is ever staged on local storage. Each part is retried independently.
+    """
+    def __init__(self, endpoint, bucket, key, region=S3_REGION, access_key=S3_ACCESS_KEY, secret_key=S3_SECRET_KEY,
+                 part_size=S3_PART_SIZE, parts_in_flight=S3_PARTS_IN_FLIGHT, retries=S3_PART_RETRIES):
+        if not (endpoint and bucket): raise ValueError("S3 destination requires BACKUP_S3_ENDPOINT and BACKUP_S3_BUCKET to be set on the server.")
+        if not (access_key and secret_key): raise ValueError("S3 credentials missing (BACKUP_S3_ACCESS_KEY / BACKUP_S3_SECRET_KEY).")
+        url = urlsplit(endpoint if '://' in endpoint else f"http://{endpoint}")
+        self.scheme, self.host = url.scheme, url.netloc
+        self.bucket, self.key, self.region = bucket, key.lstrip('/'), region
+        self.access_key, self.secret_key = access_key, secret_key
+        self.part_size, self.retries = max(part_size, 5 * 1024 * 1024), retries
+        self.name = f"s3://{bucket}/{self.key}"
+        self.buffer = bytearray(); self.parts = {}; self.futures = []; self.part_number = 0
+        self.slots = threading.BoundedSemaphore(parts_in_flight)
+        self.executor = ThreadPoolExecutor(max_workers=parts_in_flight, thread_name_prefix="s3-part")
+        self.local = threading.local(); self.upload_id = None; self.closed = False
+
+    def __enter__(self):
+        status, body, _ = self._request('POST', {'uploads': ''})
+        if status != 200: raise RuntimeError(f"S3 CreateMultipartUpload failed ({status}): {body[:200]!r}")
+        self.upload_id = self._xml_text(body, 'UploadId')
+        log_debug(f"S3 multipart upload started: {self.name} ({self.upload_id})")
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        if exc_type is not None and not self.closed: self.abort()
+        self.executor.shutdown(wait=True)
+        return False
+
+    def write(self, chunk):
+        self._raise_failed_part()
+        self.buffer += chunk
+        while len(self.buffer) >= self.part_size:
+            self._submit_part(bytes(self.buffer[:self.part_size])); del self.buffer[:self.part_size]
+
+    def finalize(self):
+        if self.buffer or self.part_number == 0: self._submit_part(bytes(self.buffer)); self.buffer.clear()
+        for future in self.futures: future.result()
+        parts_xml = ''.join(f"<Part><PartNumber>{n}</PartNumber><ETag>{etag}</ETag></Part>" for n, etag in sorted(self.parts.items()))
+        body = f"<CompleteMultipartUpload>{parts_xml}</CompleteMultipartUpload>".encode()
+        status, resp, _ = self._request('POST', {'uploadId': self.upload_id}, body)
+        if status != 200 or b'<Error>' in resp: raise RuntimeError(f"S3 CompleteMultipartUpload failed ({status}): {resp[:200]!r}")
+        self.closed = True; log_event(f"Uploaded {self.part_number} part(s) to {self.name}.", "success")
+
+    def abort(self):
+        for future in self.futures: future.cancel()
+        self.buffer.clear(); self.closed = True
+        if not self.upload_id: return
+        try:
+            self._request('DELETE', {'uploadId': self.upload_id}); log_event(f"Aborted multipart upload {self.name}.", "warn")
+        except Exception as e: log_event(f"Could not abort multipart upload (will expire server-side): {e}", "warn")
+
+    def _submit_part(self, data):
+        self.slots.acquire(); self.part_number += 1
+        future = self.executor.submit(self._upload_part, self.part_number, data)
+        future.add_done_callback(lambda _: self.slots.release()); self.futures.append(future)
+
+    def _raise_failed_part(self):
+        for future in self.futures:
+            if future.done() and future.exception(): raise future.exception()
+
+    def _upload_part(self, number, data):
+        delay = 1
+        for attempt in range(1, self.retries + 1):
+            try:
+                status, body, headers = self._request('PUT', {'partNumber': str(number), 'uploadId': self.upload_id}, data)
+                if status == 200:
+                    self.parts[number] = headers.get('etag', ''); return
+                raise RuntimeError(f"HTTP {status}: {body[:200]!r}")
+            except Exception as e:
+                if attempt == self.retries: raise RuntimeError(f"S3 part {number} failed after {attempt} attempts: {e}")
+                log_event(f"S3 part {number} attempt {attempt} failed ({e}); retrying in {delay}s.", "warn")
+                self.local.conn = None; time.sleep(delay); delay = min(delay * 2, 30)
+
+    def _connection(self):
+        if getattr(self.local, 'conn', None) is None:
+            conn_cls = http.client.HTTPSConnection if self.scheme == 'https' else http.client.HTTPConnection
+            self.local.conn = conn_cls(self.host, timeout=120)
+        return self.local.conn
+
+    def _request(self, method, params, body=b''):
+        path = '/' + quote(self.bucket, safe='') + '/' + quote(self.key, safe='/-_.~')
+        query = '&'.join(f"{quote(k, safe='-_.~')}={quote(v, safe='-_.~')}" for k, v in sorted(params.items()))
+        payload_hash = hashlib.sha256(body).hexdigest(); now = datetime.now(timezone.utc)
+        amz_date, date_stamp = now.strftime('%Y%m%dT%H%M%SZ'), now.strftime('%Y%m%d')
+        headers = {'host': self.host, 'x-amz-content-sha256': payload_hash, 'x-amz-date': amz_date}
+        signed = ';'.join(sorted(headers))
+        canonical = '\n'.join([method, path, query, ''.join(f"{k}:{headers[k]}\n" for k in sorted(headers)), signed, payload_hash])
+        scope = f"{date_stamp}/{self.region}/s3/aws4_request"
+        to_sign = '\n'.join(['AWS4-HMAC-SHA256', amz_date, scope, hashlib.sha256(canonical.encode()).hexdigest()])
+        key = f"AWS4{self.secret_key}".encode()
+        for part in (date_stamp, self.region, 's3', 'aws4_request'): key = hmac.new(key, part.encode(), hashlib.sha256).digest()
+        signature = hmac.new(key, to_sign.encode(), hashlib.sha256).hexdigest()
+        headers['Authorization'] = f"AWS4-HMAC-SHA256 Credential={self.access_key}/{scope}, SignedHeaders={signed}, Signature={signature}"
+        headers['Content-Length'] = str(len(body))
+        conn = self._connection()
+        try:
+            conn.request(method, f"{path}?{query}" if query else path, body=body, headers=headers)
+            resp = conn.getresponse(); data = resp.read()
+        except Exception: self.local.conn = None; raise
+        return resp.status, data, {k.lower(): v for k, v in resp.getheaders()}
+
+    @staticmethod
+    def _xml_text(body, tag):
+        for elem in ET.fromstring(body).iter():
+            if elem.tag.rsplit('}', 1)[-1] == tag: return elem.text
+        raise RuntimeError(f"S3 response missing <{tag}>.")
+
+class SftpUpload:
+    """Write-only file object that pushes a stream to a remote host over the SFTP subsystem.
+
+    Talks SFTP v3 directly to `ssh -s <host> sftp` so writes are pipelined: up to
+    SFTP_MAX_REQUESTS WRITE packets are outstanding at once instead of waiting for each
+    reply. Data goes to '<path>.part' and is renamed into place on finalize(). Unacknowledged
+    writes are kept in memory, so a dropped connection is resumed by offset on a fresh session.
+    With resume=True an existing '.part' is only continued after resume_from() has matched it
+    against the local file; streamed pushes (resume=False) remove it again on abort.
+    """
+    FXP_INIT, FXP_VERSION, FXP_OPEN, FXP_CLOSE, FXP_READ, FXP_WRITE, FXP_FSTAT = 1, 2, 3, 4, 5, 6, 8
+    FXP_REMOVE, FXP_RENAME, FXP_STATUS, FXP_HANDLE, FXP_DATA, FXP_ATTRS = 13, 18, 101, 102, 103, 105
+    FXF_READ, FXF_WRITE, FXF_CREAT, FXF_TRUNC = 0x01, 0x02, 0x08, 0x10
+    RESUME_CHECK_SIZE = 1024 * 1024
+
+    def __init__(self, target, port=22, resume=False, write_size=SFTP_WRITE_SIZE, max_requests=SFTP_MAX_REQUESTS, reconnects=SFTP_RECONNECTS):
+        if ':' not in (target or ''): raise ValueError("SFTP destination must look like user@host:/path/file.")
+        self.host, self.path = target.split(':', 1)
+        # The host ends up in ssh's argv: anything option-like (-oProxyCommand=...) would run commands here.
+        if not re.fullmatch(r'(?:[A-Za-z0-9._+-]+@)?[A-Za-z0-9][A-Za-z0-9.-]*', self.host): raise ValueError(f"Invalid SFTP host '{self.host}'.")
+        if not self.path: raise ValueError("SFTP destination is missing a remote path.")
+        self.port, self.write_size, self.max_requests, self.reconnects = str(int(port or 22)), write_size, max_requests, reconnects
+        self.name = f"sftp://{self.host}{'' if self.path.startswith('/') else '/'}{self.path}"
+        self.part_path = self.path + ".part"
+        self.buffer = bytearray(); self.pending = {}; self.offset = 0; self.request_id = 0
+        self.proc = None; self.handle = None; self.resume = resume; self.closed = False
+
+    def __enter__(self):
+        self._connect(truncate=not self.resume)
+        if self.resume: self.offset = self._fstat_size()
+        return self
+
+    def resume_from(self, f):
+        """Keep the remote '.part' only if it is a prefix of local file `f` (size plus its last MiB); else restart."""
+        size = os.fstat(f.fileno()).st_size; tail = min(self.offset, self.RESUME_CHECK_SIZE)
+        if 0 < self.offset <= size:
+            f.seek(self.offset - tail)
+            if f.read(tail) == self._read_range(self.offset - tail, tail):
+                log_event(f"Resuming {self.name} at offset {self.offset}.", "info"); f.seek(self.offset); return self.offset
+        if self.offset: log_event(f"Remote {self.part_path} does not match the local file; restarting the push.", "warn")
+        self._disconnect(); self._connect(truncate=True); self.offset = 0; f.seek(0)
+        return 0
+
+    def _read_range(self, offset, length):
+        data = bytearray()
+        while len(data) < length:
+            rid = self._send(self.FXP_READ, self._str(self.handle) + struct.pack('>QI', offset + len(data), min(length - len(data), 65536)))
+            ptype, reply = self._read_reply(rid)
+            if ptype != self.FXP_DATA: break
+            data += self._unpack_str(reply, 4)[0]
+        return bytes(data)
+
+    def __exit__(self, exc_type, exc, tb):
+        if exc_type is not None and not self.closed: self.abort()
+        self._disconnect()
+        return False
+
+    def write(self, chunk):
+        self.buffer += chunk
+        while len(self.buffer) >= self.write_size:
+            self._queue_write(bytes(self.buffer[:self.write_size])); del self.buffer[:self.write_size]
+
+    def finalize(self):
+        if self.buffer: self._queue_write(bytes(self.buffer)); self.buffer.clear()
+        self._with_reconnect(self._drain)
+        self._expect_status(self._send(self.FXP_CLOSE, self._str(self.handle))); self.handle = None
+        self._read_reply(self._send(self.FXP_REMOVE, self._str(self.path.encode())))  # v3 RENAME refuses to overwrite
+        self._expect_status(self._send(self.FXP_RENAME, self._str(self.part_path.encode()) + self._str(self.path.encode())))
+        self.closed = True; log_event(f"Pushed {self.offset} bytes to {self.name}.", "success")
+
+    def abort(self):
+        self.closed = True; self.buffer.clear(); self.pending.clear()
+        if self.resume: log_event(f"SFTP push aborted; partial data left at {self.part_path} for resume.", "warn"); return
+        # A streamed archive is regenerated from scratch next time, so its partial copy is useless.
+        try:
+            if self.handle: self._read_reply(self._send(self.FXP_CLOSE, self._str(self.handle))); self.handle = None
+            self._read_reply(self._send(self.FXP_REMOVE, self._str(self.part_path.encode())))
+            log_event(f"SFTP push aborted; removed partial {self.part_path}.", "warn")
+        except (OSError, EOFError, RuntimeError, struct.error):
+            log_event(f"SFTP push aborted; could not remove partial {self.part_path}.", "warn")
+
+    # --- session handling ---
+    def _connect(self, truncate):
+        cmd = [SSH_BIN, '-oBatchMode=yes', '-oCompression=no', '-oIPQoS=throughput', '-oServerAliveInterval=15',
+               '-p', self.port, '-s', '--', self.host, 'sftp']
+        self.proc = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE, bufsize=0)
+        threading.Thread(target=monitor_process_stderr, args=(self.proc, 'ssh'), daemon=True).start()
+        self._write_packet(self.FXP_INIT, struct.pack('>I', 3))
+        ptype, _ = self._read_packet()
+        if ptype != self.FXP_VERSION: raise RuntimeError("Remote host did not start an SFTP session.")
+        flags = self.FXF_WRITE | self.FXF_CREAT | (self.FXF_TRUNC if truncate else 0) | (self.FXF_READ if self.resume else 0)
+        rid = self._send(self.FXP_OPEN, self._str(self.part_path.encode()) + struct.pack('>II', flags, 0))
+        ptype, data = self._read_reply(rid)
+        if ptype != self.FXP_HANDLE: raise RuntimeError(f"Could not open remote file: {self._status_message(data)}")
+        self.handle = self._unpack_str(data, 4)[0]
+
+    def _disconnect(self):
+        if not self.proc: return
+        try: self.proc.stdin.close()
+        except OSError: pass
+        try: self.proc.wait(timeout=5)
+        except subprocess.TimeoutExpired: self.proc.kill(); self.proc.wait()
+        self.proc = None
+
+    def _with_reconnect(self, action, *args):
+        for attempt in range(self.reconnects + 1):
+            try: return action(*args)
+            except (OSError, EOFError) as e:
+                if attempt == self.reconnects: raise RuntimeError(f"SFTP connection lost: {e}")
+                log_event(f"SFTP connection lost ({e}); reconnecting and resending {len(self.pending)} unacknowledged writes.", "warn")
+                self._disconnect(); time.sleep(min(2 ** attempt, 30)); self._connect(truncate=False)
+                pending, self.pending = self.pending, {}
+                for offset, data in sorted(pending.values()): self._send_write(offset, data)
+
+    # --- pipelined writes ---
+    def _queue_write(self, data):
+        offset = self.offset; self.offset += len(data)
+        self._with_reconnect(self._send_write, offset, data)
+
+    def _send_write(self, offset, data):
+        while len(self.pending) >= self.max_requests: self._read_reply()
+        rid = self._send(self.FXP_WRITE, self._str(self.handle) + struct.pack('>Q', offset) + self._str(data))
+        self.pending[rid] = (offset, data)
+
+    def _drain(self):
+        while self.pending: self._read_reply()
+
+    def _read_reply(self, wanted=None):
+        while True:
+            ptype, data = self._read_packet(); rid = struct.unpack_from('>I', data)[0]
+            if rid in self.pending:
+                if ptype != self.FXP_STATUS or struct.unpack_from('>I', data, 4)[0] != 0:
+                    raise RuntimeError(f"Remote write failed at offset {self.pending[rid][0]}: {self._status_message(data)}")
+                del self.pending[rid]
+                if wanted is None: return ptype, data
+            elif wanted is None or rid == wanted: return ptype, data
+
+    def _fstat_size(self):
+        ptype, data = self._read_reply(self._send(self.FXP_FSTAT, self._str(self.handle)))
+        if ptype != self.FXP_ATTRS or not struct.unpack_from('>I', data, 4)[0] & 1: return 0
+        return struct.unpack_from('>Q', data, 8)[0]
+
+    def _expect_status(self, rid):
+        ptype, data = self._read_reply(rid)
+        if ptype != self.FXP_STATUS or struct.unpack_from('>I', data, 4)[0] != 0:
+            raise RuntimeError(f"SFTP request failed: {self._status_message(data)}")
+
+    # --- wire format ---
+    def _send(self, ptype, payload):
+        self.request_id = (self.request_id + 1) & 0xFFFFFFFF
+        self._write_packet(ptype, struct.pack('>I', self.request_id) + payload); return self.request_id
+
+    def _write_packet(self, ptype, payload):
+        self.proc.stdin.write(struct.pack('>IB', len(payload) + 1, ptype) + payload)
+
+    def _read_packet(self):
+        header = self._read_exact(5); length, ptype = struct.unpack('>IB', header)
+        return ptype, self._read_exact(length - 1)
+
+    def _read_exact(self, n):
+        data = bytearray()
+        while len(data) < n:
+            chunk = self.proc.stdout.read(n - len(data))
+            if not chunk: raise EOFError("SFTP session closed by remote host")
+            data += chunk
+        return bytes(data)
+
+    @staticmethod
+    def _str(value): return struct.pack('>I', len(value)) + value
+
+    @staticmethod
+    def _unpack_str(data, pos):
+        length = struct.unpack_from('>I', data, pos)[0]; return data[pos + 4:pos + 4 + length], pos + 4 + length
+
+    def _status_message(self, data):
+        try: return self._unpack_str(data, 8)[0].decode('utf-8', errors='ignore') or "unknown error"
+        except struct.error: return "malformed reply"
+
+def sftp_remote_path(config, filename):
+    base = (config.get('sftpTarget') or '').strip().rstrip('/')
+    return f"{base}{'' if base.endswith(':') else '/'}{filename}"
+
+def fadvise(fd, offset, length, advice):
+    # Hints only: missing on some platforms and refused by some FUSE mounts, never worth failing a job over.
+    if hasattr(os, 'posix_fadvise'):
+        try: os.posix_fadvise(fd, offset, length, getattr(os, f'POSIX_FADV_{advice}'))
+        except OSError: pass
+
+def page_cache_budget(config):
+    mode = config.get('cacheMode') if config.get('cacheMode') in PAGE_CACHE_MODES else 'bounded'
+    if mode == 'keep': return None
+    return 0 if mode == 'drop' else max(int(config.get('pageCacheLimitMb') or PAGE_CACHE_BUDGET_MB), 0) * 1024 * 1024
+
+def durability_mode(config):
+    return config.get('durabilityMode') if config.get('durabilityMode') in DURABILITY_MODES else 'batch'
+
+def sync_filesystem(path):
+    # syncfs(2) flushes only the filesystem holding `path`; os.sync() (all of them) where it is unavailable.
+    try:
+        import ctypes
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            if ctypes.CDLL(None, use_errno=True).syncfs(fd) == 0: return
+        finally: os.close(fd)
+    except (OSError, AttributeError): pass
+    os.sync()
+
+def fsync_path(path):
+    fd = os.open(path, os.O_RDONLY)
+    try: os.fsync(fd)
+    except OSError: pass  # some FUSE mounts refuse fsync on directories
+    finally: os.close(fd)
+
+class BufferPool:
+    """A few OUTPUT_BLOCK_SIZE bytearrays shared by the copy loops, so moving a stream allocates nothing per block."""
+    def __init__(self, size=OUTPUT_BLOCK_SIZE, count=OUTPUT_BUFFERS):
+        self.size = size; self.free = [bytearray(size) for _ in range(count)]; self.lock = threading.Lock()
+
+    def acquire(self):
+        with self.lock: return self.free.pop() if self.free else bytearray(self.size)
+
+    def release(self, buf):
+        with self.lock:
+            if len(self.free) < OUTPUT_BUFFERS: self.free.append(buf)
+
+OUTPUT_POOL = BufferPool()
+
+def copy_stream(src, write, stop=None):
+    """Move `src` into `write` one pooled block at a time; `write` gets a memoryview that is only valid
+    during the call. Returns the byte count."""
+    buf = OUTPUT_POOL.acquire(); total = 0
+    try:
+        with memoryview(buf) as view:
+            while not (stop and stop.is_set()):
+                n = src.readinto(view)
+                if not n: break
+                write(view[:n]); total += n
+    finally: OUTPUT_POOL.release(buf)
+    return total
+
+def expected_output_size(config):
+    # Input bytes from a recent plan times the ratio sampled for this selection at the job's level, or 0.
+    pruned = prune_redundant_paths(config.get('sources', []))
+    warm = SIZE_INDEX.get(selection_key(pruned, parse_excludes(config))); estimate = ESTIMATE_CACHE.get(catalog_sources_key(pruned))
+    if not warm or not estimate or time.time() - estimate[0] > ESTIMATE_CACHE_TTL: return 0
+    ratio = next((p['ratio'] for p in estimate[1] if p['level'] == (compression_level(config) or 3)), None)
+    return int(warm[1] * ratio * 1.02) if ratio else 0  # a little slack for tar headers; trimmed at finalize
+
+class LocalArchiveFile:
+    """Local archive output written in whole OUTPUT_BLOCK_SIZE blocks into a preallocated file, synced per
+    durabilityMode. Unless cacheMode is 'keep', every PAGE_CACHE_FLUSH bytes the written range is flushed
+    and dropped, so a multi-GB archive leaves a bounded footprint."""
+    def __init__(self, path, config):
+        self.name = path; self.fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC | getattr(os, 'O_CLOEXEC', 0), 0o644)
+        self.drop = page_cache_budget(config) is not None; self.durability = durability_mode(config)
+        self.pending = bytearray(); self.written = self.flushed = 0
+        self.preallocated = self._preallocate(expected_output_size(config))
+
+    def _preallocate(self, size):
+        # Reserves contiguous extents up front; best-effort, since FUSE/sdcardfs and some filesystems refuse it.
+        if not size or not hasattr(os, 'posix_fallocate'): return 0
+        try: os.posix_fallocate(self.fd, 0, size); log_debug(f"Preallocated {size} bytes for {self.name}"); return size
+        except OSError as e:
+            if e.errno == errno.ENOSPC: log_event(f"Predicted archive size ({size / 1e6:.0f} MB) exceeds the free space.", "warn")
+            return 0
+
+    def write(self, data):
+        if self.pending or len(data) % OUTPUT_BLOCK_SIZE:
+            self.pending += data
+            if len(self.pending) < OUTPUT_BLOCK_SIZE: return
+            whole = len(self.pending) - len(self.pending) % OUTPUT_BLOCK_SIZE
+            with memoryview(self.pending) as view: self._write_all(view[:whole])
+            del self.pending[:whole]
+        else: self._write_all(data)
+        if self.drop and self.written - self.flushed >= PAGE_CACHE_FLUSH: self._drop_written()
+
+    def _write_all(self, data):
+        with memoryview(data) as view:
+            while view: n = os.write(self.fd, view); self.written += n; view = view[n:]
+
+    def _drop_written(self, start=None):
+        # Dirty pages cannot be dropped, and freshly written ones may still sit in per-CPU LRU batches,
+        # so each round also retries the previous window. 'fast' never waits for the disk: DONTNEED starts
+        # writeback of the dirty pages without blocking, and the retry drops them once they are clean.
+        if self.durability != 'fast': os.fdatasync(self.fd)
+        start = max(self.flushed - PAGE_CACHE_FLUSH, 0) if start is None else start
+        fadvise(self.fd, start, self.written - start, 'DONTNEED'); self.flushed = self.written
+
+    def finalize(self):
+        if self.pending: self._write_all(self.pending); self.pending.clear()
+        if self.preallocated > self.written: os.ftruncate(self.fd, self.written)
+        if self.drop: self._drop_written(0)
+        elif self.durability != 'fast': os.fsync(self.fd)
+        if self.durability == 'strict': fsync_path(os.path.dirname(self.name))
+
+    def close(self):
+        if self.fd is not None: os.close(self.fd); self.fd = None
+    def __enter__(self): return self
+    def __exit__(self, *exc): self.close()
+
+def open_destination(config, filename):
+    destination = config.get('destination', 'local')
+    if destination == 's3':
+        prefix = (config.get('s3Prefix') or '').strip('/')
+        key = f"{prefix}/{filename}" if prefix else filename
+        return S3MultipartUpload(S3_ENDPOINT, S3_BUCKET, key)
+    if destination == 'sftp':
+        return SftpUpload(sftp_remote_path(config, filename), config.get('sftpPort') or 22)
+    if destination == 'peer':
+        # The receiver only runs zstd and tar; it has no key to undo age/gpg with.
+        if str(config.get('encrypt')).lower() == 'true': raise ValueError("Peer transfers cannot be encrypted: the receiving device would have no way to decrypt them. Turn encryption off.")
+        pruned = prune_redundant_paths(config.get('sources', []))
+        if not pruned: raise ValueError("No source directories selected.")
+        return PeerUpload(config.get('peerAddress'), config.get('peerToken'), get_common_base(pruned), sources=pruned)
+    os.makedirs(BACKUPS_PATH, exist_ok=True)
+    return LocalArchiveFile(os.path.join(BACKUPS_PATH, filename), config)
+
+# --- Peer-to-Peer LAN Transfer ---
+def choose_link_compression_level(link_mb_s, curve=None):
+    # Spend CPU only when the link is the bottleneck; fast Wi-Fi/Ethernet gets the cheapest level.
+    if curve: return choose_level_for_rate(curve, link_mb_s)
+    for threshold, level in ((80, 1), (30, 3), (10, 6)):
+        if link_mb_s >= threshold: return level
+    return 9
+
+def send_json_line(f, obj): f.write(json.dumps(obj).encode() + b'\n'); f.flush()
+
+def read_json_line(f):
+    line = f.readline()
+    if not line: raise EOFError("Peer closed the connection.")
+    return json.loads(line)
+
+class PeerUpload:
+    """Write-only file object that streams an archive into another instance's restore pipeline.
+
+    The archive is cut into PEER_CHUNK_SIZE chunks, numbered, and spread across several TCP
+    streams; the receiver reorders them and feeds `zstd -d | tar -x`. A link probe at connect
+    time picks the zstd level, and a SHA-256 of the whole stream is compared at the end.
+    """
+    def __init__(self, address, token, base, streams=PEER_STREAMS, sources=None):
+        host, _, port = (address or '').strip().partition(':')
+        if not host or not token: raise ValueError("Peer transfer requires the receiver's address and pairing code.")
+        self.host, self.port, self.token, self.base, self.streams = host, int(port or PEER_PORT), token.strip().upper(), base, streams
+        self.name = f"peer://{self.host}:{self.port}{base}"
+        self.buffer = bytearray(); self.seq = 0; self.sent_bytes = 0; self.hasher = hashlib.sha256()
+        self.queue = queue.Queue(maxsize=streams * 2); self.workers = []; self.data_socks = []; self.errors = []
+        self.control = None; self.control_file = None; self.negotiated_level = None; self.sources = sources or []
+
+    def __enter__(self):
+        self.control = socket.create_connection((self.host, self.port), timeout=30)
+        self.control_file = self.control.makefile('rwb')
+        send_json_line(self.control_file, {'token': self.token, 'probe': PEER_PROBE_BYTES})
+        reply = read_json_line(self.control_file)
+        if not reply.get('ok'): raise RuntimeError(f"Peer refused connection: {reply.get('error')}")
+        start = time.monotonic(); self.control_file.write(os.urandom(PEER_PROBE_BYTES)); self.control_file.flush()
+        read_json_line(self.control_file); link_mb_s = PEER_PROBE_BYTES / max(time.monotonic() - start, 1e-3) / 1e6
+        try: curve = estimate_for_sources(self.sources) if self.sources else None
+        except (OSError, subprocess.SubprocessError) as e: curve = None; log_debug(f"Compressibility estimate failed: {e}")
+        self.negotiated_level = choose_link_compression_level(link_mb_s, curve)
+        log_event(f"Link to peer measured at {link_mb_s:.1f} MB/s; using zstd level {self.negotiated_level} over {self.streams} streams.", "info")
+        send_json_line(self.control_file, {'base': self.base, 'streams': self.streams, 'level': self.negotiated_level})
+        for index in range(self.streams):
+            sock = socket.create_connection((self.host, self.port), timeout=30); sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            sock.settimeout(None)  # sendall blocks for as long as the receiver's reorder window is full
+            sock.sendall(json.dumps({'token': self.token, 'stream': index}).encode() + b'\n'); self.data_socks.append(sock)
+            worker = threading.Thread(target=self._stream_worker, args=(sock,), daemon=True); worker.start(); self.workers.append(worker)
+        return self
+
+    def __exit__(self, exc_type, exc, tb):
+        for sock in self.data_socks + [self.control]:
+            try: sock.close()
+            except Exception: pass
+        return False
+
+    def write(self, chunk):
+        if self.errors: raise self.errors[0]
+        self.buffer += chunk
+        while len(self.buffer) >= PEER_CHUNK_SIZE:
+            self._send_chunk(bytes(self.buffer[:PEER_CHUNK_SIZE])); del self.buffer[:PEER_CHUNK_SIZE]
+
+    def finalize(self):
+        if self.buffer: self._send_chunk(bytes(self.buffer)); self.buffer.clear()
+        for _ in self.workers: self.queue.put(None)
+        for worker in self.workers: worker.join()
+        if self.errors: raise self.errors[0]
+        digest = self.hasher.hexdigest()
+        self.control.settimeout(None)
+        send_json_line(self.control_file, {'done': True, 'chunks': self.seq, 'bytes': self.sent_bytes, 'sha256': digest})
+        result = read_json_line(self.control_file)
+        if not result.get('ok'): raise RuntimeError(f"Peer restore failed: {result.get('error')}")
+        log_event(f"Peer restored {self.sent_bytes} bytes; checksum verified ({digest[:16]}...).", "success")
+
+    def abort(self):
+        try: send_json_line(self.control_file, {'abort': True})
+        except Exception: pass
+
+    def _send_chunk(self, data):
+        self.hasher.update(data); self.sent_bytes += len(data)
+        self.queue.put((self.seq, data)); self.seq += 1
+
+    def _stream_worker(self, sock):
+        try:
+            while (item := self.queue.get()) is not None:
+                seq, data = item; sock.sendall(struct.pack('>QI', seq, len(data)) + data)
+            sock.shutdown(socket.SHUT_WR)
+        except Exception as e:
+            self.errors.append(RuntimeError(f"Peer data stream failed: {e}"))
+            while self.queue.get() is not None: pass  # keep the producer from blocking on a dead stream
+
+def recv_exact(sock, n):
+    data = bytearray()
+    while len(data) < n:
+        chunk = sock.recv(min(n - len(data), 1024 * 1024))
+        if not chunk: return None
+        data += chunk
+    return bytes(data)
+
+def recv_line(sock, limit=4096):
+    line = bytearray()  # byte-wise so no frame data is buffered away from the chunk reader
+    while not line.endswith(b'\n') and len(line) < limit:
+        byte = sock.recv(1)
+        if not byte: break
+        line += byte
+    return bytes(line)
+
+def peer_token_ok(hello, token): return hmac.compare_digest(str(hello.get('token', '')).upper().encode(), token.encode())
+
+def run_peer_receive_session(server, control, token, config):
+    control_file = control.makefile('rwb')
+    hello = read_json_line(control_file)
+    if not peer_token_ok(hello, token):
+        server.close(); send_json_line(control_file, {'ok': False, 'error': 'Wrong pairing code.'}); raise PermissionError("Peer sent a wrong pairing code.")
+    send_json_line(control_file, {'ok': True})
+    probe_left = int(hello.get('probe', 0))
+    while probe_left > 0:
+        chunk = control_file.read(min(probe_left, 1024 * 1024))
+        if not chunk: raise EOFError("Peer closed during link probe.")
+        probe_left -= len(chunk)
+    send_json_line(control_file, {'ok': True})
+    job = read_json_line(control_file); base = config.get('targetDir') or PEER_RECEIVE_PATH
+    log_event(f"Receiving '{job.get('base')}' from {control.getpeername()[0]} into '{base}' (zstd level {job.get('level')}, {job['streams']} streams).", "info")
+    os.makedirs(base, exist_ok=True)
+    processes = build_unpack_stages(subprocess.PIPE, config, [], target_dir=base)
+    sink = processes[0][1].stdin
+    state = {'next': 0, 'total': None, 'chunks': {}, 'readers_done': 0, 'error': None, 'abort': False}
+    cond = threading.Condition()
+
+    def read_stream(sock):
+        try:
+            while (header := recv_exact(sock, 12)) is not None:
+                seq, length = struct.unpack('>QI', header); data = recv_exact(sock, length)
+                if data is None: raise EOFError("Data stream ended mid-chunk.")
+                with cond:
+                    while seq - state['next'] > PEER_REORDER_WINDOW and not (state['error'] or state['abort']): cond.wait()
+                    state['chunks'][seq] = data; cond.notify_all()
+        except Exception as e:
+            with cond: state['error'] = state['error'] or e
+        finally:
+            sock.close()
+            with cond: state['readers_done'] += 1; cond.notify_all()
+
+    def read_control():
+        try:
+            message = read_json_line(control_file)
+            with cond:
+                if message.get('abort'): state['abort'] = True
+                else: state['total'], state['sha256'] = message['chunks'], message['sha256']
+                cond.notify_all()
+        except Exception as e:
+            with cond: state['error'] = state['error'] or e; cond.notify_all()
+
+    server.settimeout(30)
+    for _ in range(int(job['streams'])):
+        sock, _ = server.accept(); sock.settimeout(None)
+        stream_hello = json.loads(recv_line(sock))
+        if not peer_token_ok(stream_hello, token): sock.close(); server.close(); raise PermissionError("Data stream with wrong pairing code.")
+        threading.Thread(target=read_stream, args=(sock,), daemon=True).start()
+    threading.Thread(target=read_control, daemon=True).start()
+
+    def next_chunk():
+        with cond:
+            while state['next'] not in state['chunks']:
+                if state['error']: raise RuntimeError(f"Transfer failed: {state['error']}")
+                if state['abort']: raise RuntimeError("Sender aborted the transfer.")
+                if state['total'] is not None and state['next'] >= state['total']: return None
+                if state['total'] is not None and state['readers_done'] == streams: raise RuntimeError(f"Chunk {state['next']} never arrived.")
+                cond.wait()
+            data = state['chunks'].pop(state['next']); state['next'] += 1; cond.notify_all()
+            return data
+
+    hasher = hashlib.sha256(); received = 0; streams = int(job['streams'])
+    try:
+        while (data := next_chunk()) is not None:
+            hasher.update(data); received += len(data); sink.write(data)
+    finally:
+        with cond: state['error'] = state['error'] or RuntimeError("receiver stopped"); cond.notify_all()
+        try: sink.close()
+        except OSError: pass
+        exit_codes = {name: proc.wait() for name, proc in processes}
+    checksum_ok = hasher.hexdigest() == state['sha256']
+    ok = checksum_ok and all(code == 0 for code in exit_codes.values())
+    error = None if ok else ("Checksum mismatch." if not checksum_ok else f"Exit codes: {exit_codes}")
+    send_json_line(control_file, {'ok': ok, 'error': error, 'sha256': hasher.hexdigest()})
+    if not ok: raise RuntimeError(error)
+    log_event(f"Peer restore complete: {received} bytes, checksum verified.", "success")
+
+def run_peer_receive_task(server, token, config):
+    # One pairing attempt per listen: the listener closes after it, so the code cannot be guessed by retrying.
+    try:
+        server.settimeout(PEER_PAIRING_TIMEOUT)
+        try: control, _ = server.accept()
+        except socket.timeout: log_event("Peer receive mode timed out; listener closed.", "info"); socketio.emit('extraction_complete', {'status': 'error'}); return
+        try:
+            with control:
+                run_peer_receive_session(server, control, token, config)
+            socketio.emit('extraction_complete', {'status': 'success'})
+        except Exception as e:
+            log_event(f"Peer receive failed: {e}", "error"); socketio.emit('extraction_complete', {'status': 'error'})
+    finally: server.close()
+
+# --- Catalog ---
+CATALOG_SCHEMA = """
+CREATE TABLE IF NOT EXISTS archives (
+    id INTEGER PRIMARY KEY, name TEXT UNIQUE, location TEXT, kind TEXT, parent TEXT,
+    base TEXT, sources TEXT, created REAL, complete INTEGER DEFAULT 0, parent_id INTEGER);
+CREATE TABLE IF NOT EXISTS entries (
+    archive_id INTEGER, path TEXT, type TEXT, size INTEGER, mtime INTEGER, mode INTEGER,
+    src TEXT, hash TEXT, blocks TEXT, deleted INTEGER DEFAULT 0, frame INTEGER, seq INTEGER, PRIMARY KEY (archive_id, path)) WITHOUT ROWID;
+CREATE INDEX IF NOT EXISTS entries_path ON entries (path, archive_id);
+CREATE TABLE IF NOT EXISTS frames (
+    archive_id INTEGER, idx INTEGER, offset INTEGER, length INTEGER, raw INTEGER, members INTEGER, first INTEGER,
+    PRIMARY KEY (archive_id, idx)) WITHOUT ROWID;
+CREATE TABLE IF NOT EXISTS jobs (
+    id INTEGER PRIMARY KEY, kind TEXT, archive TEXT, started REAL, duration REAL, files INTEGER,
+    bytes_in INTEGER, bytes_out INTEGER, level INTEGER, status TEXT, profile TEXT, start_ms REAL,
+    cpu_s REAL, rss_kb INTEGER, temp_c REAL, blocked REAL);
+CREATE INDEX IF NOT EXISTS jobs_started ON jobs (kind, started);
+CREATE TABLE IF NOT EXISTS eta_model (
+    ext TEXT PRIMARY KEY, files INTEGER, bytes INTEGER, sec_per_byte REAL, sec_per_file REAL, updated REAL);
+"""
+# Columns added after a table first shipped; catalogs created earlier get them on first open.
+CATALOG_COLUMNS = {'archives': (('parent_id', 'INTEGER'),),
+                   'entries': (('frame', 'INTEGER'), ('seq', 'INTEGER')),
+                   'jobs': (('profile', 'TEXT'), ('start_ms', 'REAL'), ('cpu_s', 'REAL'), ('rss_kb', 'INTEGER'), ('temp_c', 'REAL'), ('blocked', 'REAL'))}
+
+def catalog_connect():
+    os.makedirs(CATALOG_PATH, exist_ok=True)
+    conn = sqlite3.connect(CATALOG_DB, timeout=30); conn.row_factory = sqlite3.Row
+    conn.execute("PRAGMA journal_mode=WAL")
+    for table, columns in CATALOG_COLUMNS.items():
+        existing = {row['name'] for row in conn.execute(f"PRAGMA table_info({table})")}
+        for name, kind in columns:
+            if existing and name not in existing: conn.execute(f"ALTER TABLE {table} ADD COLUMN {name} {kind}")
+    conn.executescript(CATALOG_SCHEMA)
+    return conn
+
+def catalog_sources_key(pruned_sources): return json.dumps(sorted(pruned_sources))
+
+def catalog_archive(conn, name): return conn.execute("SELECT * FROM archives WHERE name = ?", (name,)).fetchone()
+
+def catalog_parent(conn, row):
+    # Parents are linked by id, so a later archive reusing a name cannot stand in for the one an incremental was
+    # taken on; rows written before parent_id existed fall back to the name.
+    if row['parent_id'] is not None: return conn.execute("SELECT * FROM archives WHERE id = ?", (row['parent_id'],)).fetchone()
+    return catalog_archive(conn, row['parent'])
+
+def catalog_chain(conn, name):
+    """Archives needed to rebuild `name`, oldest (the full backup) first."""
+    row = catalog_archive(conn, name)
+    if row is None: raise FileNotFoundError(f"Archive '{name}' is missing from the catalog; the backup chain is broken.")
+    chain, seen = [row], {row['id']}
+    while row['parent']:
+        parent = catalog_parent(conn, row)
+        if parent is None: raise FileNotFoundError(f"Archive '{row['parent']}' (parent of '{row['name']}') is missing from the catalog; the backup chain is broken.")
+        if parent['id'] in seen: break
+        chain.append(parent); seen.add(parent['id']); row = parent
+    return chain[::-1]
+
+def catalog_finish(name, success, location=None):
+    with catalog_connect() as conn:
+        row = catalog_archive(conn, name)
+        if row is None: return
+        if success: conn.execute("UPDATE archives SET complete = 1, location = ? WHERE id = ?", (location, row['id']))
+        else:
+            for table, column in (('entries', 'archive_id'), ('frames', 'archive_id'), ('archives', 'id')): conn.execute(f"DELETE FROM {table} WHERE {column} = ?", (row['id'],))
+
+def file_versions(query, max_paths=VERSION_SEARCH_PATHS):
+    """Every recorded version of the files matching `query` (substring, or glob if it has
+    wildcards) across all complete archives. An incremental holds a file it did not re-record
+    too, so each archive is credited with the version its chain resolves to."""
+    is_pattern = any(c in query for c in '*?[')
+    with catalog_connect() as conn:
+        archives = {row['id']: row for row in conn.execute("SELECT * FROM archives WHERE complete = 1 ORDER BY id")}
+        by_name = {archive['name']: archive for archive in archives.values()}
+        parent_of = lambda archive: archives.get(archive['parent_id']) if archive['parent_id'] is not None else by_name.get(archive['parent'])
+        where = "(a.base || '/' || e.path) GLOB ?" if is_pattern else "e.path LIKE ? ESCAPE '\\'"
+        arg = query if is_pattern else '%' + query.replace('\\', '\\\\').replace('%', '\\%').replace('_', '\\_') + '%'
+        paths = conn.execute(f"SELECT DISTINCT a.base, e.path FROM entries e JOIN archives a ON a.id = e.archive_id "
+                             f"WHERE a.complete = 1 AND e.type = 'f' AND {where} ORDER BY e.path LIMIT ?", (arg, max_paths)).fetchall()
+        results = []
+        for base, rel in paths:
+            rows = {row['archive_id']: row for row in conn.execute(
+                "SELECT e.* FROM entries e JOIN archives a ON a.id = e.archive_id WHERE a.base = ? AND e.path = ?", (base, rel))}
+            versions = {}
+            for archive_id, archive in archives.items():
+                if archive['base'] != base: continue
+                cursor = archive
+                while cursor is not None and cursor['id'] not in rows:  # walk up the chain to the latest record
+                    cursor = parent_of(cursor)
+                if cursor is None: continue
+                row = rows[cursor['id']]
+                if row['deleted']: continue
+                key = row['hash'] or f"{row['size']}:{row['mtime']}"
+                version = versions.setdefault(key, {'hash': row['hash'], 'size': row['size'], 'mtime': row['mtime'], 'archives': []})
+                version['archives'].append({'name': archive['name'], 'kind': archive['kind'], 'created': archive['created'],
+                                            'local': os.path.isfile(os.path.join(BACKUPS_PATH, archive['name']))})
+            if versions:
+                results.append({'path': os.path.join(base, rel), 'base': base, 'rel': rel,
+                                'versions': sorted(versions.values(), key=lambda v: v['archives'][0]['created'])})
+    return results
+
+def run_file_restore_task(archive_name, rel, in_place, config):
+    token = CancelToken(); ACTIVE_JOBS.add(token)
+    try:
+        with catalog_connect() as conn: row = catalog_archive(conn, archive_name)
+        if row is None: raise FileNotFoundError(f"'{archive_name}' is not in the catalog.")
+        target = row['base'] if in_place else RESTORED_PATH; os.makedirs(target, exist_ok=True)
+        log_event(f"Restoring '{rel}' from '{archive_name}' to '{target}'...", "info")
+        run_chain_restore(row, {**config, 'targetDir': target}, only={rel}, token=token)
+        log_event(f"Restored '{os.path.join(target, rel)}'.", "success")
+        socketio.emit('extraction_complete', {'status': 'success'})
+    except Exception as e:
+        log_event(f"Single-file restore failed: {e}", "error")
+        socketio.emit('extraction_complete', {'status': 'error'})
+    finally: ACTIVE_JOBS.discard(token)
+
+# --- Filename Index ---
+FILE_INDEX_SCHEMA = """
+CREATE TABLE IF NOT EXISTS files (id INTEGER PRIMARY KEY, path TEXT UNIQUE, name TEXT, parent TEXT, size INTEGER, is_dir INTEGER);
+CREATE INDEX IF NOT EXISTS files_parent ON files (parent);
+CREATE TABLE IF NOT EXISTS dirs (path TEXT PRIMARY KEY, mtime_ns INTEGER) WITHOUT ROWID;
+"""
+FILE_INDEX_FTS = """
+CREATE VIRTUAL TABLE IF NOT EXISTS names USING fts5(name, content='files', content_rowid='id', tokenize='trigram');
+CREATE TRIGGER IF NOT EXISTS files_ai AFTER INSERT ON files BEGIN INSERT INTO names (rowid, name) VALUES (new.id, new.name); END;
+CREATE TRIGGER IF NOT EXISTS files_ad AFTER DELETE ON files BEGIN INSERT INTO names (names, rowid, name) VALUES ('delete', old.id, old.name); END;
+"""
+
+def file_index_connect():
+    os.makedirs(CATALOG_PATH, exist_ok=True)
+    conn = sqlite3.connect(FILE_INDEX_DB, timeout=30); conn.row_factory = sqlite3.Row
+    conn.execute("PRAGMA journal_mode=WAL"); conn.execute("PRAGMA synchronous=NORMAL"); conn.executescript(FILE_INDEX_SCHEMA)
+    try: conn.executescript(FILE_INDEX_FTS)
+    except sqlite3.OperationalError: pass  # SQLite < 3.34 has no trigram tokenizer; searches fall back to LIKE
+    return conn
+
+def file_index_roots(): return [n['id'] for n in (ROOT_NODE_CACHE or [])] or [p for p in (SHARED_STORAGE_PATH, HOME_DIR, PREFIX_DIR) if os.path.isdir(p)]
+
+def refresh_file_index(roots=None):
+    """Bring the index up to date. Every directory is stat'ed, but only those whose mtime moved
+    (entries added, removed or renamed) are listed again, so a refresh of an unchanged tree
+    costs one stat per directory. Returns (listed, visited) or None if a refresh is running."""
+    if not FILE_INDEX_LOCK.acquire(blocking=False): return None
+    try:
+        with file_index_connect() as conn:
+            known = dict(conn.execute("SELECT path, mtime_ns FROM dirs").fetchall()); seen = set(); listed = 0
+            stack = list(roots or file_index_roots())
+            while stack:
+                path = stack.pop()
+                if path in seen or path in (CATALOG_PATH, STAGING_PATH, REPORTS_PATH): continue
+                seen.add(path)
+                try: mtime_ns = os.stat(path).st_mtime_ns
+                except OSError: continue
+                if known.get(path) == mtime_ns:
+                    stack.extend(r[0] for r in conn.execute("SELECT path FROM files WHERE parent = ? AND is_dir = 1", (path,))); continue
+                try:
+                    with os.scandir(path) as it: entries = list(it)
+                except OSError: continue
+                rows = []
+                for entry in entries:
+                    try: is_dir = entry.is_dir(follow_symlinks=False); size = 0 if is_dir else entry.stat(follow_symlinks=False).st_size
+                    except OSError: continue
+                    rows.append((entry.path, entry.name, path, size, int(is_dir)))
+                    if is_dir: stack.append(entry.path)
+                conn.execute("DELETE FROM files WHERE parent = ?", (path,))
+                conn.executemany("INSERT OR REPLACE INTO files (path, name, parent, size, is_dir) VALUES (?, ?, ?, ?, ?)", rows)
+                conn.execute("INSERT OR REPLACE INTO dirs VALUES (?, ?)", (path, mtime_ns)); listed += 1
+                if listed % 500 == 0: conn.commit()
+            gone = [p for p in known if p not in seen]
+            for path in gone: conn.execute("DELETE FROM files WHERE parent = ?", (path,)); conn.execute("DELETE FROM dirs WHERE path = ?", (path,))
+        return listed, len(seen)
+    finally: FILE_INDEX_LOCK.release()
+
+def search_file_index(query, limit=FILE_SEARCH_LIMIT):
+    with file_index_connect() as conn:
+        has_fts = conn.execute("SELECT 1 FROM sqlite_master WHERE name = 'names'").fetchone()
+        if has_fts and len(query) >= 3:
+            rows = conn.execute("SELECT f.path, f.name, f.size, f.is_dir FROM names JOIN files f ON f.id = names.rowid WHERE names MATCH ? "
+                                "ORDER BY length(f.name), f.path LIMIT ?", ('"' + query.replace('"', '""') + '"', limit)).fetchall()
+        else:
+            pattern = '%' + query.replace('\\', '\\\\').replace('%', '\\%').replace('_', '\\_') + '%'
+            rows = conn.execute("SELECT path, name, size, is_dir FROM files WHERE name LIKE ? ESCAPE '\\' ORDER BY length(name), path LIMIT ?", (pattern, limit)).fetchall()
+        indexed = conn.execute("SELECT count(*) FROM files").fetchone()[0]
+    results = []
+    for row in rows:  # sizes are only as fresh as the last listing of the parent, so re-stat the hits
+        try: st = os.lstat(row['path'])
+        except OSError: continue
+        results.append({'path': row['path'], 'name': row['name'], 'size': 0 if row['is_dir'] else st.st_size, 'is_dir': bool(row['is_dir'])})
+    return results, indexed
+
+def file_index_loop():
+    while True:
+        started = time.monotonic(); result = refresh_file_index()
+        if result: log_debug(f"File index refreshed: listed {result[0]} of {result[1]} directories in {time.monotonic() - started:.1f}s")
+        time.sleep(FILE_INDEX_INTERVAL)
+
+# --- Archive Engine ---
+def snapshot_key(st): return (st.st_ino, st.st_size, st.st_mtime_ns, st.st_ctime_ns)
+
+def compress_frame(data, level):
+    # zstandard when installed, otherwise one zstd process per frame (frames are MiBs, so the spawn is noise).
+    if zstandard: return zstandard.ZstdCompressor(level=level).compress(data)
+    return subprocess.run([ZSTD_BIN, "-q", "-c", f"-{level}"], input=data, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, check=True).stdout
+
+class FramedOutput:
+    """Archive output made of independent zstd frames, for synthetic fulls. The writer calls header()
+    before each entry, which cuts a frame once SYNTH_FRAME_SIZE of tar has collected; a big file is split
+    into continuation frames holding nothing else. Frames compress SYNTH_FRAME_WORKERS at a time and are
+    written in order, and `frames` collects [offset, length, raw, members] for the catalog."""
+    def __init__(self, out, level):
+        self.out, self.level = out, level; self.raw = bytearray(); self.members = 0; self.continued = False
+        self.queue = deque(); self.frames = []; self.offset = self.count = 0
+        self.pool = ThreadPoolExecutor(max_workers=SYNTH_FRAME_WORKERS, thread_name_prefix="zstd-frame")
+
+    def header(self, size):
+        # Returns the index of the frame the entry starts in. Big files start a frame, so they can be reused on their own.
+        if len(self.raw) >= SYNTH_FRAME_SIZE or self.continued or size >= SYNTH_FRAME_SIZE: self.cut()
+        self.members += 1; return self.count
+
+    def write(self, data):
+        self.raw += data
+        if len(self.raw) >= 2 * SYNTH_FRAME_SIZE: self.cut(); self.continued = True
+
+    def cut(self):
+        self.continued = False
+        if not self.raw: return
+        self._queue(self.pool.submit(compress_frame, bytes(self.raw), self.level), len(self.raw), self.members)
+        self.raw.clear(); self.members = 0
+
+    def trailer(self):
+        # The end-of-archive blocks get a frame of their own (members -1) that is never copied.
+        self.cut(); self.members = -1
+
+    def copy(self, frames):
+        """Splice in frames of an earlier archive, given as (compressed bytes, raw size, members); read lazily."""
+        self.cut()
+        for data, raw, members in frames: self._queue(data, raw, members)
+
+    def _queue(self, item, raw, members):
+        self.queue.append((item, raw, members)); self.count += 1
+        while self.queue and (len(self.queue) > SYNTH_FRAME_WORKERS or isinstance(self.queue[0][0], bytes) or self.queue[0][0].done()): self._emit()
+
+    def _emit(self):
+        item, raw, members = self.queue.popleft(); data = item if isinstance(item, bytes) else item.result()
+        self.out.write(data); self.frames.append([self.offset, len(data), raw, members]); self.offset += len(data)
+
+    def finish(self):
+        self.cut()
+        while self.queue: self._emit()
+        self.out.flush(); return self.frames
+
+    def close(self):
+        self.pool.shutdown(wait=False, cancel_futures=True); self.out.close()
+
+class ArchiveWriter(threading.Thread):
+    """In-process tar writer that feeds the compression stages in place of an external tar.
+
+    Every entry passes through Python, so the writer can hash what it stores, record a
+    manifest in the catalog and, for incremental backups, skip unchanged files and store
+    only the changed blocks of large files. It mimics the Popen interface (wait/poll/
+    terminate/returncode, 0 = ok, 1 = entries skipped, 2 = fatal) so the pipeline
+    bookkeeping treats it like the tar process it replaces.
+    """
+    def __init__(self, base, rel_sources, out, config, sources_key):
+        super().__init__(daemon=True)
+        self.args = ['archive']; self.base, self.rel_sources, self.out = base, rel_sources, out
+        self.policy = config.get('errorHandling', 'ignore')
+        self.show_progress = str(config.get('showFileProgress')).lower() == 'true'
+        self.archive_name = config.get('archiveName'); self.sources_key = sources_key
+        self.incremental = config.get('backupType') == 'incremental' and bool(self.archive_name)
+        self.failed_files = []; self.error_event = CancelToken(); self.stop_event = threading.Event()
+        self.returncode = None; self.bytes_written = 0; self.conn = None; self.archive_id = None; self.chain_ids = []
+        self.snapshot = str(config.get('snapshotMode')).lower() == 'true'
+        self.sqlite_backup = str(config.get('sqliteBackup')).lower() == 'true'
+        self.hot_files = 0; self.captured_dbs = set(); self.staging_dir = None
+        self.report_name = f"{self.archive_name or datetime.now().strftime('stream_%Y%m%d_%H%M%S')}.failures.jsonl"
+        self.report_file = None; self.failure_counts = {'stage': {}, 'error': {}}
+        self.excludes = parse_excludes(config); self.files_written = 0; self.total_size = None
+        self.write_wait = 0.0; self.recent_files = deque(maxlen=4 * PROGRESS_FILE_NAMES)  # sampled by PROGRESS
+        self.eta_model = EtaModel.load(); self.eta = EtaEstimator(); self.total_cost = None; self.cost_done = 0.0
+        self.byte_cost = 0.0; self.ext_stats = {}; self.small_files = [0, 0.0]  # actuals the model learns from
+        self.symlink_policy = symlink_policy(config); self.roots = [os.path.realpath(os.path.join(base, rel)) for rel in rel_sources]
+        self.deferred_links = deque(); self.followed = set(); self.link_counts = {}
+        self.cache_allowance = page_cache_budget(config)  # bytes of read data still allowed to stay cached; None = no limit
+        self.frames_out = out if isinstance(out, FramedOutput) else None; self.entry_frame = None; self.seq = 0; self.frame_first = {}
+        self.record_frames = str(config.get('encrypt')).lower() != 'true'  # offsets are only meaningful in a plain .tar.zst
+        self.reuse = None; self.held = []; self.reused = [0, 0]
+
+    # --- Popen-compatible surface ---
+    def poll(self): return None if self.is_alive() else self.returncode
+    def wait(self, timeout=None): self.join(timeout); return self.returncode
+    def terminate(self): self.stop_event.set()
+    kill = terminate
+
+    def run(self):
+        try:
+            if self.archive_name: self._open_catalog()
+            for rel in self.rel_sources:
+                self._walk(rel, frozenset(), follow=True)
+                if self.stop_event.is_set() or self.error_event.is_set(): break
+            self._resolve_links()
+            if self.hot_files: log_event(f"{self.hot_files} file(s) changed while being copied; archived stable copies.", "info")
+            self._release_held()
+            if self.conn: self._record_deletions(); self.conn.commit()
+            if self.frames_out: self.frames_out.trailer()
+            self._write(b'\0' * (2 * tarfile.BLOCKSIZE))
+            self._write(b'\0' * (-self.bytes_written % tarfile.RECORDSIZE))
+            if self.frames_out: self._finish_frames()
+            self.returncode = 2 if (self.stop_event.is_set() or self.error_event.is_set()) else (1 if self.failed_files else 0)
+        except (BrokenPipeError, ValueError) as e:
+            if not (self.stop_event.is_set() or self.error_event.is_set()): log_event(f"Archive stream closed early: {e}", "error")
+            self.returncode = 2
+        except Exception as e:
+            log_event(f"Archive engine failed: {e}", "error"); self.returncode = 2
+        finally:
+            if self.conn: self.conn.close()
+            if self.reuse: os.close(self.reuse['fd'])
+            if self.staging_dir: shutil.rmtree(self.staging_dir, ignore_errors=True)
+            if self.report_file: self.report_file.close()
+            try: self.out.close()
+            except OSError: pass
+
+    # --- catalog ---
+    def _open_catalog(self):
+        self.conn = catalog_connect()
+        old = catalog_archive(self.conn, self.archive_name)
+        if old:
+            for table, column in (('entries', 'archive_id'), ('frames', 'archive_id'), ('archives', 'id')): self.conn.execute(f"DELETE FROM {table} WHERE {column} = ?", (old['id'],))
+        parent = None
+        if self.incremental:
+            parent = self.conn.execute("SELECT id, name FROM archives WHERE sources = ? AND complete = 1 ORDER BY created DESC LIMIT 1", (self.sources_key,)).fetchone()
+            if parent is None: log_event("No previous backup of these sources in the catalog; taking a full backup instead.", "warn"); self.incremental = False
+            else:
+                self.chain_ids = [row['id'] for row in catalog_chain(self.conn, parent['name'])]
+                log_event(f"Incremental backup on top of '{parent['name']}' (chain of {len(self.chain_ids)}).", "info")
+        self.archive_id = self.conn.execute(
+            "INSERT INTO archives (name, kind, parent, parent_id, base, sources, created) VALUES (?, ?, ?, ?, ?, ?, ?)",
+            (self.archive_name, 'incremental' if self.incremental else 'full', parent['name'] if parent else None, parent['id'] if parent else None,
+             self.base, self.sources_key, time.time())).lastrowid
+        if self.incremental: self.conn.execute("CREATE TEMP TABLE seen (path TEXT PRIMARY KEY) WITHOUT ROWID")
+        if self.frames_out: self.reuse = self._reuse_source()
+
+    def _previous(self, rel):
+        if not self.chain_ids: return None
+        row = self.conn.execute(
+            f"SELECT * FROM entries WHERE path = ? AND archive_id IN ({','.join('?' * len(self.chain_ids))}) ORDER BY archive_id DESC LIMIT 1",
+            (rel, *self.chain_ids)).fetchone()
+        return None if row is None or row['deleted'] else row
+
+    def _record(self, rel, kind, st, src=None, digest=None, blocks=None):
+        if not self.conn: return
+        frame = seq = None
+        if self.frames_out: frame, seq = self.entry_frame, self.seq; self.seq += 1; self.frame_first.setdefault(frame, seq)
+        self.conn.execute("INSERT OR REPLACE INTO entries (archive_id, path, type, size, mtime, mode, src, hash, blocks, frame, seq) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+                          (self.archive_id, rel, kind, st.st_size if kind == 'f' else 0, int(st.st_mtime), stat.S_IMODE(st.st_mode),
+                           src, digest, json.dumps(blocks) if blocks is not None else None, frame, seq))
+
+    def _record_deletions(self):
+        if not self.incremental: return
+        ids = ','.join('?' * len(self.chain_ids))
+        self.conn.execute(f"""
+            INSERT INTO entries (archive_id, path, type, deleted)
+            SELECT ?, path, type, 1 FROM (
+                SELECT path, type, deleted, ROW_NUMBER() OVER (PARTITION BY path ORDER BY archive_id DESC) AS rn
+                FROM entries WHERE archive_id IN ({ids}))
+            WHERE rn = 1 AND deleted = 0 AND path NOT IN (SELECT path FROM temp.seen)""", (self.archive_id, *self.chain_ids))
+
+    # --- walking ---
+    def _walk(self, rel, ancestors, follow=False, via_link=False):
+        if self.stop_event.is_set() or self.error_event.is_set(): return
+        path = os.path.join(self.base, rel)
+        if path in (CATALOG_PATH, STAGING_PATH, REPORTS_PATH): return  # written by this very job
+        if self.excludes and is_excluded(rel, self.excludes, path): return
+        if self.captured_dbs and rel.endswith(SQLITE_SIDECARS) and rel.rsplit('-', 1)[0] in self.captured_dbs: return
+        try: st = os.stat(path) if follow else os.lstat(path)
+        except OSError as e: self._fail(rel, e, 'stat'); return
+        if stat.S_ISLNK(st.st_mode):  # decided after the roots are walked, so real paths win over links to them
+            self.deferred_links.append((rel, ancestors)); return
+        if self.incremental: self.conn.execute("INSERT OR IGNORE INTO temp.seen VALUES (?)", (rel,))
+        if stat.S_ISDIR(st.st_mode):
+            key = (st.st_dev, st.st_ino)
+            if key in ancestors: self._fail(rel, OSError(errno.ELOOP, "File system loop detected; not dumped"), 'walk'); return
+            if via_link: self.followed.add(key)
+            previous = self._previous(rel) if self.incremental else None
+            if not previous or previous['mtime'] != int(st.st_mtime) or previous['type'] != 'd':
+                self._emit(rel, 'd', st, self._tarinfo(rel, st, tarfile.DIRTYPE))
+            try: names = sorted(os.listdir(path))
+            except OSError as e: self._fail(rel, e, 'list'); return
+            for name in names: self._walk(os.path.join(rel, name), ancestors | {key}, via_link=via_link)
+        elif stat.S_ISREG(st.st_mode):
+            if via_link: self.followed.add((st.st_dev, st.st_ino))
+            self._emit(rel, 'f', st, path=path)
+        elif stat.S_ISFIFO(st.st_mode) or stat.S_ISCHR(st.st_mode) or stat.S_ISBLK(st.st_mode):
+            kind = tarfile.FIFOTYPE if stat.S_ISFIFO(st.st_mode) else (tarfile.CHRTYPE if stat.S_ISCHR(st.st_mode) else tarfile.BLKTYPE)
+            info = self._tarinfo(rel, st, kind)
+            if kind != tarfile.FIFOTYPE: info.devmajor, info.devminor = os.major(st.st_rdev), os.minor(st.st_rdev)
+            self._emit(rel, 'o', st, info)
+
+    def _resolve_links(self):
+        # Links to files wait for all directory links, so a file inside a followed directory is archived there.
+        file_links = deque()
+        while (self.deferred_links or file_links) and not (self.stop_event.is_set() or self.error_event.is_set()):
+            if self.deferred_links:
+                rel, ancestors = self.deferred_links.popleft(); path = os.path.join(self.base, rel)
+                if self.symlink_policy != 'store' and os.path.isfile(path): file_links.append((rel, ancestors)); continue
+            else: rel, ancestors = file_links.popleft(); path = os.path.join(self.base, rel)
+            action, reason, _ = classify_symlink(path, self.symlink_policy, self.roots, ancestors, self.followed,
+                                                 lambda real: skipped_at_real_path(real, self.base, self.rel_sources, self.roots, self.excludes))
+            self.link_counts[reason] = self.link_counts.get(reason, 0) + 1
+            if action == 'follow': self._walk(rel, ancestors, follow=True, via_link=True); continue
+            try: st, target = os.lstat(path), os.readlink(path)
+            except OSError as e: self._fail(rel, e, 'stat'); continue
+            if reason == 'loop': log_debug(f"{rel}: symlink loop, stored as a link")
+            if self.incremental: self.conn.execute("INSERT OR IGNORE INTO temp.seen VALUES (?)", (rel,))
+            info = self._tarinfo(rel, st, tarfile.SYMTYPE); info.linkname = target
+            self._emit(rel, 'l', st, info)
+
+    # --- synthetic full ---
+    def _reuse_source(self):
+        """The newest framed archive of these sources, provided its file is still on disk as catalogued."""
+        row = self.conn.execute("SELECT * FROM archives WHERE sources = ? AND complete = 1 AND id IN (SELECT archive_id FROM frames) "
+                                "ORDER BY created DESC LIMIT 1", (self.sources_key,)).fetchone()
+        if row is None: log_event("No earlier synthetic full of these sources; compressing everything this time.", "info"); return None
+        frames = self.conn.execute("SELECT * FROM frames WHERE archive_id = ? ORDER BY idx", (row['id'],)).fetchall()
+        try: fd = os.open(row['location'] or '', os.O_RDONLY)
+        except OSError: fd = None
+        if fd is None or os.fstat(fd).st_size != frames[-1]['offset'] + frames[-1]['length']:
+            if fd is not None: os.close(fd)
+            log_event(f"'{row['name']}' is no longer on disk as catalogued; compressing everything this time.", "warn"); return None
+        entries = {r['path']: r for r in self.conn.execute("SELECT * FROM entries WHERE archive_id = ? AND frame IS NOT NULL", (row['id'],))}
+        log_event(f"Synthetic full on top of '{row['name']}' ({len(frames)} frames).", "info")
+        return {'name': row['name'], 'fd': fd, 'frames': frames, 'entries': entries}
+
+    def _emit(self, rel, kind, st, info=None, path=None):
+        # Entries unchanged since the reuse source are held back while they continue one of its frames.
+        if self.reuse and self._hold(rel, kind, st, info, path): return
+        self._emit_fresh(rel, kind, st, info, path)
+
+    def _emit_fresh(self, rel, kind, st, info, path):
+        if kind == 'f': self._add_file(rel, path, st)
+        else: self._write_header(info); self._record(rel, kind, st)
+
+    def _hold(self, rel, kind, st, info, path):
+        prev = self.reuse['entries'].get(rel)
+        same = (prev is not None and prev['type'] == kind and prev['mtime'] == int(st.st_mtime) and prev['mode'] == stat.S_IMODE(st.st_mode)
+                and (kind != 'f' or (prev['size'] == st.st_size and not (self.sqlite_backup and os.path.exists(path + '-wal')))))
+        if not (same and self.held and prev['frame'] == self.held[0][5]['frame'] and prev['seq'] == self.held[0][5]['seq'] + len(self.held)):
+            self._release_held()
+            if not same or prev['seq'] != self.reuse['frames'][prev['frame']]['first']: return False
+        self.held.append((rel, kind, st, info, path, prev))
+        frame = self.reuse['frames'][prev['frame']]
+        if len(self.held) == frame['members']: self._copy_held(frame)
+        return True
+
+    def _release_held(self):
+        held, self.held = self.held, []
+        for rel, kind, st, info, path, _ in held: self._emit_fresh(rel, kind, st, info, path)
+
+    def _copy_held(self, frame):
+        # The frame and its continuation frames (a big file's tail) are contiguous in the source archive.
+        frames, held, self.held = self.reuse['frames'], self.held, []; end = frame['idx'] + 1
+        while end < len(frames) and not frames[end]['members']: end += 1
+        self.frames_out.cut(); self.entry_frame = self.frames_out.count
+        for rel, kind, st, info, path, prev in held:
+            blocks = [[h, self.archive_name] for h, _ in json.loads(prev['blocks'])] if prev['blocks'] else None
+            self._record(rel, kind, st, self.archive_name if kind == 'f' else None, prev['hash'], blocks)
+            if kind == 'f': self.files_written += 1; self.cost_done += self.eta_model.sec_per_file + st.st_size * self.eta_model.byte_cost(file_ext(rel))
+            if self.show_progress: self.recent_files.append(rel)
+        def read(f):
+            data = os.pread(self.reuse['fd'], f['length'], f['offset'])
+            if len(data) != f['length'] or not data.startswith(ZSTD_MAGIC): raise RuntimeError(f"frame {f['idx']} of '{self.reuse['name']}' is damaged")
+            return data, f['raw'], f['members']
+        self.frames_out.copy(read(f) for f in frames[frame['idx']:end])
+        raw = sum(f['raw'] for f in frames[frame['idx']:end]); self.bytes_written += raw; self.reused[0] += len(held); self.reused[1] += raw
+
+    def _finish_frames(self):
+        frames = self.frames_out.finish()
+        if self.conn and self.record_frames:
+            self.conn.executemany("INSERT INTO frames VALUES (?, ?, ?, ?, ?, ?, ?)",
+                                  [(self.archive_id, idx, *frame, self.frame_first.get(idx)) for idx, frame in enumerate(frames)]); self.conn.commit()
+        if self.reuse:
+            log_event(f"Synthetic full: {self.reused[0]} entries ({self.reused[1] / 1e6:.1f} MB of tar) copied from '{self.reuse['name']}' "
+                      f"without re-reading; {self.bytes_written - self.reused[1]:,} bytes compressed fresh.", "info")
+
+    def _add_file(self, rel, path, st, staged=False):
+        ext = file_ext(rel); self.cost_done += self.eta_model.sec_per_file
+        self.byte_cost = self.eta_model.byte_cost(ext); started = time.perf_counter(); written = self.bytes_written
+        try: self._add_file_timed(rel, path, st, staged)
+        finally:
+            elapsed = time.perf_counter() - started; self.byte_cost = 0.0
+            if self.bytes_written != written:  # files skipped as unchanged or unreadable took no real time to learn from
+                stats = self.ext_stats.setdefault(ext, [0, 0, 0.0]); stats[0] += 1; stats[1] += st.st_size; stats[2] += elapsed
+                if st.st_size < ETA_SMALL_FILE: self.small_files[0] += 1; self.small_files[1] += elapsed
+
+    def _add_file_timed(self, rel, path, st, staged):
+        previous = self._previous(rel) if self.incremental else None
+        if not staged and previous and previous['type'] == 'f' and previous['size'] == st.st_size and previous['mtime'] == int(st.st_mtime):
+            self.cost_done += st.st_size * self.byte_cost; return  # unchanged: its share of the estimate is done
+        if self.sqlite_backup and not staged and st.st_size >= 512 and self._is_sqlite(path):
+            if (copy := self._stage_sqlite(rel, path, st)): self.captured_dbs.add(rel); return self._add_file_timed(rel, copy, os.stat(copy), staged=True)
+        if self.snapshot and not staged and (copy := self._stage_stable(rel, path)):
+            try: return self._add_file_timed(rel, copy, os.stat(copy), staged=True)
+            finally: os.remove(copy)
+        try: f = open(path, 'rb')
+        except OSError as e: self._fail(rel, e, 'open'); return
+        # Files that fit in the job's page-cache allowance stay cached; larger ones are dropped behind the reader.
+        keep = self.cache_allowance is None or st.st_size <= self.cache_allowance
+        if keep and self.cache_allowance is not None: self.cache_allowance -= st.st_size
+        f.drop_behind = not keep; fadvise(f.fileno(), 0, 0, 'SEQUENTIAL')
+        try:
+            with f:
+                stored = False
+                if previous and previous['type'] == 'f' and previous['blocks'] and st.st_size >= BLOCK_DELTA_MIN_SIZE:
+                    stored = self._add_block_delta(rel, f, st, previous)
+                    if not stored: f.seek(0)
+                if not stored: self._add_full_file(rel, f, st)
+                if f.drop_behind: fadvise(f.fileno(), 0, 0, 'DONTNEED')
+            if self.snapshot and not staged and snapshot_key(st) != snapshot_key(os.stat(path)): log_event(f"'{rel}' changed while it was archived live.", "warn")
+        except OSError as e: self._fail(rel, e, 'read')
+
+    # --- snapshot mode ---
+    def _staging_path(self, name):
+        if not self.staging_dir: os.makedirs(STAGING_PATH, exist_ok=True); self.staging_dir = tempfile.mkdtemp(dir=STAGING_PATH)
+        return os.path.join(self.staging_dir, name)
+
+    def _is_sqlite(self, path):
+        try:
+            with open(path, 'rb') as f: return f.read(16) == SQLITE_MAGIC
+        except OSError: return False
+
+    def _stage_sqlite(self, rel, path, st):
+        # The online backup API yields a transactionally consistent copy, WAL contents included.
+        copy = self._staging_path(f"db-{len(self.captured_dbs)}.sqlite")
+        try:
+            source = sqlite3.connect(f"file:{quote(path)}?mode=ro", uri=True, timeout=10)
+            try:
+                target = sqlite3.connect(copy)
+                try: source.backup(target, pages=1024, sleep=0.05)
+                finally: target.close()
+            finally: source.close()
+            os.chmod(copy, stat.S_IMODE(st.st_mode)); os.utime(copy, ns=(st.st_atime_ns, st.st_mtime_ns))
+            log_debug(f"{rel}: captured through SQLite online backup")
+            return copy
+        except sqlite3.Error as e:
+            log_event(f"SQLite backup of '{rel}' failed ({e}); archiving the raw file.", "warn")
+            return None
+
+    def _stage_stable(self, rel, path):
+        """Copy a file to staging until a copy is taken without the file changing; None archives it live instead."""
+        copy = self._staging_path("snapshot-file")
+        for attempt in range(1, SNAPSHOT_RETRIES + 1):
+            try: before = os.stat(path); shutil.copy2(path, copy); after = os.stat(path)
+            except OSError as e: log_event(f"Could not stage '{rel}' ({e}); archiving it live.", "warn"); return None
+            if snapshot_key(before) == snapshot_key(after): return copy
+            if attempt == 1: self.hot_files += 1
+            if attempt == SNAPSHOT_RETRIES: log_event(f"'{rel}' kept changing; archived the last staged copy.", "warn"); return copy
+            time.sleep(0.2 * attempt)
+
+    def _add_full_file(self, rel, f, st):
+        info = self._tarinfo(rel, st, tarfile.REGTYPE); info.size = st.st_size
+        self._write_header(info)
+        digest = hashlib.blake2b(digest_size=16); blocks = [] if st.st_size >= BLOCK_DELTA_MIN_SIZE else None
+        remaining = st.st_size; read_error = None
+        while remaining > 0:
+            try: data = f.read(min(BLOCK_MAP_SIZE, remaining))
+            except OSError as e: data, read_error = b'', e
+            if not data:  # file shrank or became unreadable mid-way: keep the stream valid, like tar does
+                self._fail(rel, read_error or OSError(errno.EIO, f"File shrank by {remaining} bytes; padding with zeros"), 'read', st.st_size - remaining)
+                self._write(b'\0' * remaining); self._write(b'\0' * (-info.size % tarfile.BLOCKSIZE)); return
+            digest.update(data)
+            if blocks is not None: blocks.append([hashlib.blake2b(data, digest_size=16).hexdigest(), self.archive_name])
+            if f.drop_behind:  # read the next block ahead while this one compresses, drop this one after
+                fadvise(f.fileno(), st.st_size - remaining + len(data), BLOCK_MAP_SIZE, 'WILLNEED')
+            self._write(data); remaining -= len(data)
+            if f.drop_behind: fadvise(f.fileno(), st.st_size - remaining - len(data), len(data), 'DONTNEED')
+            if self.stop_event.is_set() or self.error_event.is_set(): raise BrokenPipeError("archive stopped")
+        self._write(b'\0' * (-info.size % tarfile.BLOCKSIZE))
+        self._record(rel, 'f', st, self.archive_name, digest.hexdigest(), blocks)
+
+    def _add_block_delta(self, rel, f, st, previous):
+        # Pass 1 hashes every block; pass 2 stores only the blocks that differ from the chain.
+        old_blocks = json.loads(previous['blocks']); hashes = []; digest = hashlib.blake2b(digest_size=16)
+        for data in iter(lambda: f.read(BLOCK_MAP_SIZE), b''):
+            digest.update(data); hashes.append(hashlib.blake2b(data, digest_size=16).hexdigest())
+        changed = [i for i, h in enumerate(hashes) if i >= len(old_blocks) or old_blocks[i][0] != h]
+        if len(changed) * 2 > len(hashes): return False  # mostly rewritten: a fresh full copy keeps chains short
+        size = sum(min(BLOCK_MAP_SIZE, st.st_size - i * BLOCK_MAP_SIZE) for i in changed)
+        info = self._tarinfo(BLOCKS_PREFIX + rel, st, tarfile.REGTYPE); info.size = size
+        info.pax_headers = {'TWBS.blocks': ','.join(map(str, changed)), 'TWBS.size': str(st.st_size)}
+        self._write_header(info)
+        for i in changed:
+            f.seek(i * BLOCK_MAP_SIZE); length = min(BLOCK_MAP_SIZE, st.st_size - i * BLOCK_MAP_SIZE)
+            data = f.read(length)
+            if len(data) < length: self._fail(rel, OSError(errno.EIO, "File shrank during backup"), 'read', i * BLOCK_MAP_SIZE + len(data)); data += b'\0' * (length - len(data))
+            block_hash = hashlib.blake2b(data, digest_size=16).hexdigest()
+            if block_hash != hashes[i]: hashes[i] = block_hash; digest = None  # changed between passes: trust what was stored
+            self._write(data)
+        self._write(b'\0' * (-size % tarfile.BLOCKSIZE))
+        changed_set = set(changed)
+        blocks = [[h, self.archive_name if i in changed_set else old_blocks[i][1]] for i, h in enumerate(hashes)]
+        self._record(rel, 'f', st, previous['src'], digest.hexdigest() if digest else None, blocks)
+        log_debug(f"{rel}: stored {len(changed)}/{len(hashes)} changed blocks")
+        return True
+
+    # --- output ---
+    def _tarinfo(self, name, st, kind):
+        info = tarfile.TarInfo(name); info.type = kind
+        info.mode, info.uid, info.gid, info.mtime = stat.S_IMODE(st.st_mode), st.st_uid, st.st_gid, int(st.st_mtime)
+        return info
+
+    def _write_header(self, info):
+        if self.frames_out: self.entry_frame = self.frames_out.header(info.size)
+        self._write(info.tobuf(tarfile.PAX_FORMAT, 'utf-8', 'surrogateescape')); self.files_written += info.isreg()
+        if self.show_progress and not info.name.startswith(BLOCKS_PREFIX): self.recent_files.append(info.name)
+
+    def _write(self, data):
+        if data:
+            start = time.perf_counter(); self.out.write(data)
+            self.write_wait += time.perf_counter() - start; self.bytes_written += len(data); self.cost_done += len(data) * self.byte_cost
+
+    # --- failure reporting ---
+    def _fail(self, rel, error, stage, bytes_done=0):
+        code = getattr(error, 'errno', None); name = errno.errorcode.get(code, type(error).__name__)
+        record = {'path': os.path.join(self.base, rel), 'errno': code, 'error': name, 'message': getattr(error, 'strerror', None) or str(error),
+                  'stage': stage, 'bytes': bytes_done, 'time': round(time.time(), 3)}
+        self.failed_files.append(record['path'])
+        for key, value in (('stage', stage), ('error', name)): self.failure_counts[key][value] = self.failure_counts[key].get(value, 0) + 1
+        try:
+            if not self.report_file:
+                os.makedirs(REPORTS_PATH, exist_ok=True); self.report_file = open(os.path.join(REPORTS_PATH, self.report_name), 'w', buffering=1)
+            self.report_file.write(json.dumps(record) + '\n')
+        except OSError as e: log_debug(f"Could not write failure report: {e}")
+        socketio.emit('log_message', {'level': 'stderr', 'message': f"[archive:{stage}] {rel}: {record['message']} ({name})"})
+        if self.policy == 'abort':
+            log_event(f"Critical error on '{rel}': {record['message']}. Aborting.", 'error'); self.error_event.cancel(f"{stage} failed on '{rel}'")
+
+    def failure_summary(self):
+        return {'count': len(self.failed_files), 'by_stage': self.failure_counts['stage'], 'by_error': self.failure_counts['error'],
+                'report': self.report_name if self.failed_files else None}
+
+def run_chain_restore(archive_row, config, is_uploaded_file=False, only=None, token=None):
+    """Rebuild the state recorded for an incremental archive by replaying its chain, oldest first.
+
+    Each archive contributes only what the final state still takes from it: whole files whose
+    latest version lives there, and the blocks of large files that were last changed there.
+    With `only` (a set of relative paths), just those entries are restored and archives of the
+    chain that hold none of their data are not read at all. Cancelling `token` stops the current stages.
+    """
+    root = config.get('targetDir') or os.getcwd()
+    extract_args = {'filter': 'tar'} if hasattr(tarfile, 'tar_filter') else {}; strict = durability_mode(config) == 'strict'
+    with catalog_connect() as conn:
+        chain = catalog_chain(conn, archive_row['name']); ids = [row['id'] for row in chain]
+        target_id = chain[-1]['id']; placeholders = ','.join('?' * len(ids))
+        def latest(path):
+            row = conn.execute(f"SELECT e.*, a.name AS archive FROM entries e JOIN archives a ON a.id = e.archive_id WHERE e.path = ? AND e.archive_id IN ({placeholders}) ORDER BY e.archive_id DESC LIMIT 1", (path, *ids)).fetchone()
+            return None if row is None or row['deleted'] else row
+        if only is not None:
+            states = [state for state in map(latest, only) if state is not None]
+            if not states: raise FileNotFoundError(f"Nothing to restore: {', '.join(sorted(only))} not in '{archive_row['name']}'.")
+            needed = {state['archive'] for state in states} | {state['src'] for state in states if state['src']}
+            needed |= {block[1] for state in states if state['blocks'] for block in json.loads(state['blocks'])}
+            chain = [row for row in chain if row['name'] in needed]
+        patched, dir_times, current = {}, [], []
+        if token: abort_on_cancel(token, current, "Restore")  # tears down whichever archive is being read
+        for position, row in enumerate(chain, 1):
+            if token and token.is_set(): raise RuntimeError(f"Restore aborted: {token.reason}")
+            log_event(f"[{position}/{len(chain)}] Replaying '{row['name']}' ({row['kind']})...", "info")
+            member_config = {**config, 'filename': row['name'], 'restoreMode': 'delta'}
+            processes = build_extraction_pipeline(member_config, is_uploaded_file and row['id'] == target_id); current[:] = processes
+            try:
+                with processes[-1][1].stdout as stream, tarfile.open(fileobj=stream, mode='r|', copybufsize=OUTPUT_BLOCK_SIZE) as archive:
+                    for member in archive:
+                        if token and token.is_set(): raise RuntimeError(f"Restore aborted: {token.reason}")
+                        is_delta = member.name.startswith(BLOCKS_PREFIX)
+                        path = member.name[len(BLOCKS_PREFIX):] if is_delta else member.name.rstrip('/')
+                        if only is not None and path not in only: continue
+                        state = latest(path)
+                        if state is None: continue
+                        if not within_restore_root(root, path):
+                            log_event(f"Skipped '{path}': it would be written outside the restore target.", "warn"); continue
+                        dest = os.path.join(root, path)
+                        if is_delta:
+                            indices = [int(i) for i in member.pax_headers.get('TWBS.blocks', '').split(',') if i]
+                            blocks = json.loads(state['blocks']); src = archive.extractfile(member)
+                            with open(dest, 'r+b') as out:
+                                for index in indices:
+                                    data = src.read(min(BLOCK_MAP_SIZE, int(member.pax_headers['TWBS.size']) - index * BLOCK_MAP_SIZE))
+                                    if index < len(blocks) and blocks[index][1] == row['name']: out.seek(index * BLOCK_MAP_SIZE); out.write(data)
+                            patched[dest] = state
+                        elif state['type'] == 'f' and state['src'] == row['name']:
+                            archive.extract(member, root, **extract_args)
+                            if state['blocks']: patched[dest] = state
+                            elif strict: fsync_path(dest)
+                        elif state['type'] != 'f' and state['archive_id'] == row['id']:
+                            if state['type'] == 'd': dir_times.append((dest, state['mtime']))
+                            archive.extract(member, root, **extract_args)
+                    while stream.read(1024 * 1024): pass
+                exit_codes = {name: proc.wait() for name, proc in processes}
+                if any(exit_codes.values()): raise RuntimeError(f"Reading '{row['name']}' failed. Exit codes: {exit_codes}")
+            finally:
+                stop_stages(processes)
+        for dest, state in patched.items():
+            os.truncate(dest, state['size']); os.chmod(dest, state['mode']); os.utime(dest, (state['mtime'], state['mtime']))
+            if strict: fsync_path(dest)
+        for dest, mtime in reversed(dir_times):
+            try: os.utime(dest, (mtime, mtime))
+            except OSError: pass
+    log_event(f"Chain restore complete: {len(chain)} archive(s) replayed, {len(patched)} block-mapped file(s) reassembled.", "success")
+
+# --- Planning ---
+def scan_selection(base, rel_sources, excludes, policy='within'):
+    """Metadata-only walk with the archive engine's rules (symlink policy, loops and the server's
+    own directories skipped). Returns totals plus the (path, size) list used for sampling."""
+    totals = {'files': 0, 'dirs': 0, 'other': 0, 'bytes': 0, 'excluded_files': 0, 'excluded_bytes': 0, 'unreadable': 0, 'symlinks': {}}
+    files = []; stack = [(rel, frozenset(), True, False) for rel in reversed(rel_sources)]
+    roots = [os.path.realpath(os.path.join(base, rel)) for rel in rel_sources]; deferred = deque(); followed = set()
+    skipped = lambda real: skipped_at_real_path(real, base, rel_sources, roots, excludes)
+    file_links = deque()
+    while stack or deferred or file_links:
+        if not stack:  # roots done: settle the links, as the engine does (file links after all directory links)
+            if deferred:
+                rel, ancestors = deferred.popleft()
+                if policy != 'store' and os.path.isfile(os.path.join(base, rel)): file_links.append((rel, ancestors)); continue
+            else: rel, ancestors = file_links.popleft()
+            action, reason, _ = classify_symlink(os.path.join(base, rel), policy, roots, ancestors, followed, skipped)
+            totals['symlinks'][reason] = totals['symlinks'].get(reason, 0) + 1
+            if action == 'link': totals['other'] += 1; continue
+            stack.append((rel, ancestors, True, True))
+        rel, ancestors, follow, via_link = stack.pop(); path = os.path.join(base, rel)
+        if path in (CATALOG_PATH, STAGING_PATH, REPORTS_PATH): continue
+        try: st = os.stat(path) if follow else os.lstat(path)
+        except OSError: totals['unreadable'] += 1; continue
+        if stat.S_ISLNK(st.st_mode):
+            if not (excludes and is_excluded(rel, excludes, path)): deferred.append((rel, ancestors))
+            continue
+        if excludes and is_excluded(rel, excludes, path):
+            if stat.S_ISDIR(st.st_mode):
+                for dirpath, _, names in os.walk(path):
+                    for name in names:
+                        try: totals['excluded_bytes'] += os.stat(os.path.join(dirpath, name)).st_size; totals['excluded_files'] += 1
+                        except OSError: pass
+            else: totals['excluded_files'] += 1; totals['excluded_bytes'] += st.st_size
+            continue
+        if stat.S_ISDIR(st.st_mode):
+            key = (st.st_dev, st.st_ino)
+            if key in ancestors: continue
+            if via_link: followed.add(key)
+            totals['dirs'] += 1
+            try: names = sorted(os.listdir(path), reverse=True)
+            except OSError: totals['unreadable'] += 1; continue
+            stack.extend((os.path.join(rel, name), ancestors | {key}, False, via_link) for name in names)
+        elif stat.S_ISREG(st.st_mode):
+            if via_link: followed.add((st.st_dev, st.st_ino))
+            totals['files'] += 1; totals['bytes'] += st.st_size
+            if st.st_size: files.append((path, st.st_size))
+        else: totals['other'] += 1
+    return totals, files
+
+def sample_selection(files, total_bytes, samples=PLAN_SAMPLES, size=PLAN_SAMPLE_SIZE):
+    # Byte-weighted: every byte of the selection is equally likely to land in the sample,
+    # so one huge video outweighs ten thousand small configs, as it does in the archive.
+    if not files or not total_bytes: return []
+    ends = []; acc = 0
+    for _, length in files: acc += length; ends.append(acc)
+    chunks = []
+    for point in sorted(random.randrange(total_bytes) for _ in range(samples)):
+        index = bisect.bisect_right(ends, point); path, length = files[index]
+        offset = max(min(point - (ends[index] - length), length - size), 0)
+        try:
+            with open(path, 'rb') as f: f.seek(offset); chunks.append(f.read(size))
+        except OSError: pass
+    return chunks
+
+def sample_by_descent(pruned_sources, samples=PLAN_SAMPLES, size=PLAN_SAMPLE_SIZE, budget=ESTIMATE_BUDGET):
+    """Sampler for when no full walk is available: each sample is a random descent from a source
+    root, entering a subdirectory or picking a file (weighted by size) in proportion to how many
+    of each the directory holds. Cost depends on tree depth, not on how much data is selected."""
+    chunks = []; deadline = time.monotonic() + budget; attempts = 0
+    while len(chunks) < samples and attempts < samples * 8 and time.monotonic() < deadline:
+        attempts += 1; path = random.choice(pruned_sources)
+        for _ in range(64):
+            if os.path.isfile(path):
+                try:
+                    with open(path, 'rb') as f:
+                        length = os.fstat(f.fileno()).st_size
+                        if length: f.seek(random.randrange(max(length - size, 0) + 1)); chunks.append(f.read(size))
+                except OSError: pass
+                break
+            try:
+                with os.scandir(path) as it: entries = [e for e in it if e.path not in (CATALOG_PATH, STAGING_PATH, REPORTS_PATH)]
+                dirs = [e.path for e in entries if e.is_dir()]; files = [(e.path, e.stat().st_size) for e in entries if e.is_file()]
+            except OSError: break
+            files = [f for f in files if f[1]]
+            if not dirs and not files: break
+            if files and random.random() >= len(dirs) / (len(dirs) + len(files)):
+                path = random.choices([f[0] for f in files], weights=[f[1] for f in files])[0]
+            else: path = random.choice(dirs)
+    return chunks
+
+def estimate_compressibility(chunks, levels=ESTIMATE_LEVELS):
+    """Compress one sample at several zstd levels at once and return the ratio/speed curve for it:
+    [{'level', 'ratio', 'mb_s'}], where mb_s is single-thread input throughput."""
+    data = b''.join(chunks)
+    if not data: return []
+    def measure(level):
+        started = time.perf_counter()
+        proc = subprocess.run([ZSTD_BIN, "-c", "-q", "-T1", f"-{level}"], input=data, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, timeout=60)
+        if proc.returncode != 0: return None
+        return {'level': level, 'ratio': round(len(proc.stdout) / len(data), 4), 'mb_s': round(len(data) / max(time.perf_counter() - started, 1e-6) / 1e6, 1)}
+    with ThreadPoolExecutor(max_workers=min(len(levels), os.cpu_count() or 1)) as pool:
+        return [point for point in pool.map(measure, sorted(set(levels))) if point]
+
+def estimate_for_sources(pruned_sources):
+    key = catalog_sources_key(pruned_sources); cached = ESTIMATE_CACHE.get(key)
+    if cached and time.time() - cached[0] < ESTIMATE_CACHE_TTL: return cached[1]
+    curve = estimate_compressibility(sample_by_descent(pruned_sources))
+    ESTIMATE_CACHE[key] = (time.time(), curve); return curve
+
+def choose_level_for_rate(curve, link_mb_s):
+    # Input throughput at a level is capped by the compressor (all cores) or by the link carrying
+    # the compressed bytes; among levels within 5% of the best, take the one that compresses most.
+    cores = os.cpu_count() or 1
+    rates = {p['level']: min(p['mb_s'] * cores, link_mb_s / max(p['ratio'], 1e-3)) for p in curve}
+    best = max(rates.values())
+    return max(level for level, rate in rates.items() if rate >= best * 0.95)
+
+def historical_throughput(level):
+    # Median tar-stream throughput of recent successful backups, preferring the same level.
+    with catalog_connect() as conn:
+        rows = conn.execute("SELECT bytes_in / duration AS rate, level FROM jobs WHERE kind = 'backup' AND status = 'success' "
+                            "AND duration > 1 AND bytes_in > 1048576 ORDER BY started DESC LIMIT ?", (PLAN_HISTORY,)).fetchall()
+    rates = sorted(r['rate'] for r in rows if r['level'] == level) or sorted(r['rate'] for r in rows)
+    return rates[len(rates) // 2] if rates else None
+
+def plan_backup(config):
+    pruned_sources = prune_redundant_paths(config.get('sources', []))
+    if not pruned_sources: raise ValueError("No source directories selected.")
+    base = get_common_base(pruned_sources); level = compression_level(config) or 3
+    started = time.monotonic()
+    totals, files = scan_selection(base, [os.path.relpath(p, base) for p in pruned_sources], parse_excludes(config), symlink_policy(config))
+    chunks = sample_selection(files, totals['bytes']); curve = estimate_compressibility(chunks, ESTIMATE_LEVELS + (level,))
+    ESTIMATE_CACHE[catalog_sources_key(pruned_sources)] = (time.time(), curve)
+    ratio = next((p['ratio'] for p in curve if p['level'] == level), None)
+    rate = historical_throughput(level); free = shutil.disk_usage(BACKUPS_PATH if os.path.isdir(BACKUPS_PATH) else HOME_DIR).free
+    predicted = int(totals['bytes'] * ratio) if ratio is not None else None
+    mix = selection_mix(totals, files); model = EtaModel.load(); modelled = model.cost(mix) if model.learned else None
+    SIZE_INDEX[selection_key(pruned_sources, parse_excludes(config))] = (time.time(), totals['bytes'], mix)
+    return {**totals, 'sources': pruned_sources, 'level': level, 'sampled_bytes': sum(len(c) for c in chunks),
+            'ratio': round(ratio, 4) if ratio is not None else None, 'predicted_bytes': predicted,
+            'throughput': int(rate) if rate else None, 'predicted_seconds': round(modelled) if modelled is not None else (round(totals['bytes'] / rate) if rate else None),
+            'curve': curve, 'incompressible': bool(curve) and curve[0]['ratio'] > 0.95, 'free_bytes': free, 'fits': predicted is None or predicted < free, 'plan_seconds': round(time.monotonic() - started, 2)}
+
+def record_job(kind, archive, started, files, bytes_in, bytes_out, level, status, **metrics):
+    # metrics: profile, start_ms, cpu_s, rss_kb, temp_c, blocked (see job_resources())
+    columns = ('profile', 'start_ms', 'cpu_s', 'rss_kb', 'temp_c', 'blocked')
+    try:
+        with catalog_connect() as conn:
+            conn.execute(f"INSERT INTO jobs (kind, archive, started, duration, files, bytes_in, bytes_out, level, status, {', '.join(columns)}) "
+                         f"VALUES ({', '.join('?' * (9 + len(columns)))})",
+                         (kind, archive, started, time.time() - started, files, bytes_in, bytes_out, level, status, *(metrics.get(c) for c in columns)))
+    except sqlite3.Error as e: log_debug(f"Could not record job history: {e}")
+
+def device_temperature():
+    # Battery sensor first (tenths of a degree on Android), then the first thermal zone (millidegrees).
+    for path, scale in (("/sys/class/power_supply/battery/temp", 10), ("/sys/class/thermal/thermal_zone0/temp", 1000)):
+        try:
+            with open(path) as f: return int(f.read().strip()) / scale
+        except (OSError, ValueError): continue
+    return None
+
+def job_resources(reset_peak=False):
+    """CPU seconds used so far by the server and its reaped stages, and the server's peak RSS in KiB.
+    reset_peak restarts the peak (VmHWM) at the current RSS via /proc/self/clear_refs, so the value read at
+    the end of a job is that job's peak; without /proc it falls back to ru_maxrss, the process lifetime peak.
+    Jobs overlapping in time share these counters, so concurrent runs are charged approximately."""
+    if reset_peak:
+        try:
+            with open('/proc/self/clear_refs', 'w') as f: f.write('5')
+        except OSError: pass
+    own, children = resource.getrusage(resource.RUSAGE_SELF), resource.getrusage(resource.RUSAGE_CHILDREN); peak = own.ru_maxrss
+    try:
+        with open('/proc/self/status') as f: peak = next(int(line.split()[1]) for line in f if line.startswith('VmHWM:'))
+    except (OSError, StopIteration, ValueError, IndexError): pass
+    return own.ru_utime + own.ru_stime + children.ru_utime + children.ru_stime, peak
+
+def job_history(limit=JOB_HISTORY_LIMIT):
+    with catalog_connect() as conn:
+        rows = conn.execute("SELECT * FROM jobs WHERE kind = 'backup' ORDER BY started DESC LIMIT ?", (limit,)).fetchall()
+    history = []
+    for row in reversed(rows):
+        job = dict(row); duration = max(job['duration'] or 0, 1e-3)
+        job.update({'mb_s_in': (job['bytes_in'] or 0) / duration / 1048576, 'mb_s_out': (job['bytes_out'] or 0) / duration / 1048576,
+                    'files_s': (job['files'] or 0) / duration, 'ratio': job['bytes_out'] / job['bytes_in'] if job['bytes_in'] else None})
+        history.append(job)
+    return history
+
+# --- ETA Model ---
+def file_ext(name):
+    ext = os.path.splitext(name)[1].lower()
+    return ext if 1 < len(ext) <= 10 else ''
+
+def selection_mix(totals, files):
+    """{extension: [files, bytes]} of a scan_selection() result; empty files count towards ''."""
+    mix = {'': [totals['files'] - len(files), 0]}
+    for path, size in files:
+        entry = mix.setdefault(file_ext(path), [0, 0]); entry[0] += 1; entry[1] += size
+    return mix
+
+class EtaModel:
+    """Seconds a file costs on this device: a fixed per-file overhead (open, stat, header) plus its
+    size times the learned seconds/byte of its extension. Media that zstd cannot shrink and source
+    trees of tiny files get very different rates, which one bytes/s figure cannot express."""
+    DEFAULT_SEC_PER_FILE = 0.0005; DEFAULT_SEC_PER_BYTE = 1 / (20 * 1024 * 1024)
+
+    def __init__(self, rows=()):
+        rows = {row['ext']: row for row in rows}; overall = rows.pop('*', None); self.learned = overall is not None
+        self.sec_per_file = overall['sec_per_file'] if overall else self.DEFAULT_SEC_PER_FILE
+        self.sec_per_byte = overall['sec_per_byte'] if overall else self.DEFAULT_SEC_PER_BYTE
+        self.by_ext = {ext: row['sec_per_byte'] for ext, row in rows.items()}
+
+    @classmethod
+    def load(cls):
+        try:
+            with catalog_connect() as conn: return cls(conn.execute("SELECT * FROM eta_model").fetchall())
+        except sqlite3.Error: return cls()
+
+    def byte_cost(self, ext): return self.by_ext.get(ext, self.sec_per_byte)
+
+    def cost(self, mix): return sum(files * self.sec_per_file + size * self.byte_cost(ext) for ext, (files, size) in mix.items())
+
+def learn_eta_model(writer):
+    """Blend a finished job's per-extension timings into the model (EWMA, so a one-off slow run
+    caused by a hot device or a busy phone only moves it part of the way)."""
+    small_count, small_seconds = writer.small_files
+    files = sum(s[0] for s in writer.ext_stats.values()); size = sum(s[1] for s in writer.ext_stats.values())
+    if not files or size < ETA_MIN_LEARN_BYTES: return
+    model = writer.eta_model; w = ETA_LEARN_WEIGHT; now = time.time()
+    per_file = small_seconds / small_count if small_count >= 20 else model.sec_per_file
+    def blend(old, new, learned): return old * (1 - w) + new * w if learned else new
+    seconds = sum(s[2] for s in writer.ext_stats.values())
+    overall = max(seconds - files * per_file, 0) / size
+    rows = [('*', files, size, blend(model.sec_per_byte, overall, model.learned), blend(model.sec_per_file, per_file, model.learned), now)]
+    for ext, (count, ext_bytes, ext_seconds) in writer.ext_stats.items():
+        if ext_bytes < ETA_MIN_LEARN_BYTES: continue
+        observed = max(ext_seconds - count * per_file, 0) / ext_bytes
+        rows.append((ext, count, ext_bytes, blend(model.by_ext.get(ext, observed), observed, True), per_file, now))
+    try:
+        with catalog_connect() as conn:
+            conn.executemany("INSERT INTO eta_model VALUES (?, ?, ?, ?, ?, ?) ON CONFLICT(ext) DO UPDATE SET files = files + excluded.files, "
+                             "bytes = bytes + excluded.bytes, sec_per_byte = excluded.sec_per_byte, sec_per_file = excluded.sec_per_file, updated = excluded.updated", rows)
+            conn.execute("DELETE FROM eta_model WHERE ext IN (SELECT ext FROM eta_model WHERE ext != '*' ORDER BY updated DESC LIMIT -1 OFFSET ?)", (ETA_MAX_EXTENSIONS,))
+    except sqlite3.Error as e: log_debug(f"Could not update the ETA model: {e}")
+
+class EtaEstimator:
+    """Scalar Kalman filter over k, the model-seconds of work a job completes per wall second.
+    Before any measurement k = 1 (trust the model); noisy ticks (one huge file, a stall while zstd
+    flushes) only nudge it, so the ETA converges instead of jumping."""
+    def __init__(self): self.k, self.variance, self.last = 1.0, 1.0, None
+
+    def update(self, now, done, total):
+        if self.last:
+            elapsed = now - self.last[0]
+            if elapsed > 0:
+                self.variance += ETA_PROCESS_NOISE * elapsed; gain = self.variance / (self.variance + ETA_MEASUREMENT_NOISE)
+                self.k += gain * ((done - self.last[1]) / elapsed - self.k); self.variance *= 1 - gain
+        self.last = (now, done)
+        return max(total - done, 0) / max(self.k, 0.05) if total else None
+
+# --- Profiles ---
+def load_profiles():
+    try:
+        with open(PROFILES_FILE) as f: return json.load(f)
+    except (OSError, ValueError): return {}
+
+def save_profiles(profiles):
+    os.makedirs(CATALOG_PATH, exist_ok=True); tmp = PROFILES_FILE + ".tmp"
+    with open(tmp, 'w') as f: json.dump(profiles, f, indent=2)
+    os.replace(tmp, PROFILES_FILE)
+
+def warm_profile(name, profile):
+    try: WARM_PLANS[name] = {**plan_backup(profile), 'warmed': time.time()}
+    except (ValueError, OSError, subprocess.SubprocessError) as e: log_debug(f"Could not warm profile '{name}': {e}")
+
+def run_profile(name, trigger="manual"):
+    with PROFILES_LOCK:
+        profiles = load_profiles(); profile = profiles.get(name)
+        if profile is None: raise KeyError(name)
+        profile['lastRun'] = datetime.now().isoformat(timespec='seconds'); save_profiles(profiles)
+    # encryptionMethod is saved even with encryption off (null, '' or 'none'), so only a real method counts.
+    encrypt = str(profile.get('encrypt')).lower() == 'true' and profile.get('encryptionMethod') in ('age', 'gpg')
+    if encrypt and profile.get('encryptionMethod') == 'age': raise ValueError("age profiles need a passphrase and cannot run unattended.")
+    log_event(f"Starting profile '{name}' ({trigger}).", "info")
+    config = {k: profile.get(k) for k in PROFILE_FIELDS}; config['encrypt'] = encrypt; config['profile'] = name
+    threading.Thread(target=run_local_backup_job, args=(config,), daemon=True).start()
+
+def profile_slot(profile, now):
+    """Today's scheduled start for a profile, or None if it has no valid HH:MM schedule."""
+    schedule = (profile.get('schedule') or '').strip()
+    if not re.fullmatch(r'([01]\d|2[0-3]):[0-5]\d', schedule): return None
+    return now.replace(hour=int(schedule[:2]), minute=int(schedule[3:]), second=0, microsecond=0)
+
+def profile_due(profile, now, since):
+    # Slots that passed before `since` (while the server was down) are not caught up.
+    slot = profile_slot(profile, now)
+    return slot is not None and since <= slot <= now and not (profile.get('lastRun') or '').startswith(now.strftime('%Y-%m-%d'))
+
+def profile_loop():
+    # Start due jobs, and re-plan a profile (refreshing the size index) only in the half hour before it runs.
+    since = datetime.now() - timedelta(seconds=SCHEDULER_TICK)
+    while True:
+        if not ACTIVE_JOBS:
+            now = datetime.now()
+            for name, profile in load_profiles().items():
+                if profile_due(profile, now, since):
+                    try: run_profile(name, "scheduled")
+                    except (KeyError, ValueError) as e: log_event(f"Scheduled profile '{name}' skipped: {e}", "warn")
+                    break  # one job at a time; the next tick picks up the rest
+                slot = profile_slot(profile, now)
+                if slot and now < slot <= now + timedelta(seconds=PROFILE_WARM_INTERVAL) and time.time() - WARM_PLANS.get(name, {}).get('warmed', 0) > PROFILE_WARM_INTERVAL:
+                    warm_profile(name, profile)
+        time.sleep(SCHEDULER_TICK)
 
 # --- Core Logic ---
+def get_common_base(pruned_sources):
+    return os.path.commonpath(pruned_sources) if len(pruned_sources)>1 else os.path.dirname(pruned_sources[0])
+
 def build_backup_pipeline(config):
     sources = config.get('sources', []);
     if not sources: raise ValueError("No source directories selected.")
@@ -125,40 +2186,32 @@ def build_backup_pipeline(config):
     for path in pruned_sources:
         if not os.access(path, os.R_OK): raise PermissionError(f"Permission Denied for '{path}'.")
     
-    total_size = 0; cache_map = {node['id']: node['data'].get('size_bytes', 0) for node in (ROOT_NODE_CACHE or [])}
-    if all(p in cache_map for p in pruned_sources):
+    total_size = mix = None; cache_map = {node['id']: node['data'].get('size_bytes', 0) for node in (ROOT_NODE_CACHE or [])}
+    warm = SIZE_INDEX.get(selection_key(pruned_sources, parse_excludes(config)))
+    if warm and time.time() - warm[0] < 2 * PROFILE_WARM_INTERVAL:
+        total_size, mix = warm[1], warm[2]; log_debug(f"Total size from warm plan: {total_size} bytes")
+    elif all(p in cache_map for p in pruned_sources):
         total_size = sum(cache_map.get(p, 0) for p in pruned_sources)
         log_debug(f"Calculated total size from cache: {total_size} bytes")
-    else:
-        base = os.path.commonpath(pruned_sources) if len(pruned_sources)>1 else os.path.dirname(pruned_sources[0])
-        rel_sources = [os.path.relpath(p, base) for p in pruned_sources]
-        try:
-            cmd = f"cd {quote(base)} && '{DU_BIN}' -sb {' '.join(map(quote, rel_sources))}"
-            output = subprocess.check_output(cmd, shell=True, timeout=30).decode('utf-8')
-            if output: total_size = sum(int(line.split()[0]) for line in output.strip().split('\n'))
-        except Exception as e: log_event(f"Could not calculate total size (often OK): {e}", "warn")
 
-    common_base = os.path.commonpath(pruned_sources) if len(pruned_sources)>1 else os.path.dirname(pruned_sources[0])
+    common_base = get_common_base(pruned_sources)
     relative_sources = [os.path.relpath(p, common_base) for p in pruned_sources]
-    processes = []; error_policy = config.get('errorHandling', 'ignore')
-    show_progress = str(config.get('showFileProgress')).lower() == 'true'
-
-    tar_verb = "v" if show_progress else ""
-    tar_cmd = [STDBUF_BIN, '-oL', TAR_BIN, f"-ch{tar_verb}f", "-"]
-    if error_policy == 'ignore': tar_cmd.append("--ignore-failed-read")
-    tar_cmd.extend(["-C", common_base, *relative_sources])
-    
-    pv_cmd = [PV_BIN, '-f', '-p', '-t', '-e', '-r', '-b', '-B', '256k']
-    if total_size > 0: pv_cmd.extend(['-s', str(total_size)])
+    if config.get('backupType') == 'synthetic':  # the writer compresses its own frames, so there is no zstd stage
+        read_fd, write_fd = os.pipe(); zstd_proc = None; compressed = os.fdopen(read_fd, 'rb')
+        writer = ArchiveWriter(common_base, relative_sources, FramedOutput(os.fdopen(write_fd, 'wb'), compression_level(config) or 3), config, catalog_sources_key(pruned_sources))
+        processes = [("archive", writer)]
+    else:
+        zstd_proc = ZSTD_POOL.acquire(compression_level(config) or 3); compressed = zstd_proc.stdout
+        writer = ArchiveWriter(common_base, relative_sources, zstd_proc.stdin, config, catalog_sources_key(pruned_sources))
+        processes = [("archive", writer), ("zstd", zstd_proc)]
+    writer.total_size = total_size
+    if mix: writer.total_cost = writer.eta_model.cost(mix)
+    else:  # nothing warm: scan the selection in parallel instead of before the start
+        threading.Thread(target=measure_selection, args=(writer, common_base, relative_sources), daemon=True).start()
 
-    tar_proc = subprocess.Popen(tar_cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE); processes.append(("tar", tar_proc))
-    pv_proc = subprocess.Popen(pv_cmd, stdin=tar_proc.stdout, stdout=subprocess.PIPE, stderr=subprocess.PIPE); processes.append(("pv", pv_proc))
-    zstd_proc = subprocess.Popen([ZSTD_BIN, "-T0"], stdin=pv_proc.stdout, stdout=subprocess.PIPE, stderr=subprocess.PIPE); processes.append(("zstd", zstd_proc))
-    tar_proc.stdout.close(); pv_proc.stdout.close()
-    
-    final_proc = zstd_proc
+    final_proc = zstd_proc; final_stream = compressed
     if str(config.get('encrypt')).lower() == 'true':
-        method = config.get('encryptionMethod'); last_out = zstd_proc.stdout
+        method = config.get('encryptionMethod'); last_out = compressed
         if method == 'age':
             password = config.get('encryptionPassword');
             if not password: raise ValueError("Age encryption requires a passphrase.")
@@ -172,17 +2225,16 @@ def build_backup_pipeline(config):
             gpg_cmd = [GPG_BIN, "--encrypt", "--recipient", recipient, "--output", "-"]
             final_proc = subprocess.Popen(gpg_cmd, stdin=last_out, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
             last_out.close()
-        processes.append((method, final_proc))
+        processes.append((method, final_proc)); final_stream = final_proc.stdout
         
-    error_event = threading.Event(); failed_files = []
-    
-    threading.Thread(target=monitor_process_stderr, args=(tar_proc, 'tar', error_event, error_policy, failed_files, common_base), daemon=True).start()
-    threading.Thread(target=monitor_pv_progress, args=(pv_proc,), daemon=True).start()
-    threading.Thread(target=monitor_process_stderr, args=(zstd_proc, 'zstd'), daemon=True).start()
+    abort_on_cancel(writer.error_event, processes, "Backup")
+    writer.start()
+    PROGRESS.register(writer, config.get('archiveName') or 'Stream')
+    if zstd_proc: threading.Thread(target=monitor_process_stderr, args=(zstd_proc, 'zstd'), daemon=True).start()
     if final_proc is not zstd_proc:
         threading.Thread(target=monitor_process_stderr, args=(final_proc, final_proc.args[0]), daemon=True).start()
 
-    return final_proc.stdout, processes, error_event, failed_files
+    return final_stream, processes, writer.error_event, writer.failed_files
 
 def build_extraction_pipeline(config, is_uploaded_file=False):
     filename = config.get('filename')
@@ -193,7 +2245,7 @@ def build_extraction_pipeline(config, is_uploaded_file=False):
     try: env['GPG_TTY'] = os.ttyname(sys.stdout.fileno())
     except Exception: log_event("Could not determine TTY for prompts.", "warn")
 
-    cat_proc = subprocess.Popen([CAT_BIN, source_path], stdout=subprocess.PIPE, stderr=subprocess.PIPE); processes.append(("cat", cat_proc))
+    cat_proc = spawn_stage([CAT_BIN, source_path], stdout=subprocess.PIPE, stderr=subprocess.PIPE); processes.append(("cat", cat_proc))
     next_input = cat_proc.stdout
     
     if filename.endswith(".age"):
@@ -205,13 +2257,22 @@ def build_extraction_pipeline(config, is_uploaded_file=False):
         gpg_proc = subprocess.Popen(gpg_cmd, stdin=next_input, stdout=subprocess.PIPE, stderr=subprocess.PIPE, env=env)
         next_input.close(); processes.append(("gpg", gpg_proc)); next_input = gpg_proc.stdout
         
-    zstd_proc = subprocess.Popen([f"{ZSTD_BIN}cat"], stdin=next_input, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-    processes.append(("zstd", zstd_proc)); next_input.close()
+    return build_unpack_stages(next_input, config, processes)
+
+def build_unpack_stages(next_input, config, processes, target_dir=None):
+    # `next_input` may be subprocess.PIPE, in which case the caller feeds processes[0]'s stdin.
+    zstd_proc = spawn_stage([f"{ZSTD_BIN}cat"], stdin=next_input, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    processes.append(("zstd", zstd_proc))
+    if next_input is not subprocess.PIPE: next_input.close()
+
+    if config.get('restoreMode') == 'delta':
+        threading.Thread(target=monitor_process_stderr, args=(zstd_proc, 'zstd'), daemon=True).start()
+        return processes  # the caller reads the tar stream from zstd itself
 
     show_progress = str(config.get('showFileProgress')).lower() == 'true'
     tar_verb = "v" if show_progress else ""
-    tar_cmd = [TAR_BIN, f"-x{tar_verb}f", "-"]
-    tar_proc = subprocess.Popen(tar_cmd, stdin=zstd_proc.stdout, stderr=subprocess.PIPE)
+    tar_cmd = [TAR_BIN, f"-x{tar_verb}f", "-"] + (["-C", target_dir] if target_dir else [])
+    tar_proc = spawn_stage(tar_cmd, stdin=zstd_proc.stdout, stderr=subprocess.PIPE)
     processes.append(("tar", tar_proc)); zstd_proc.stdout.close()
     
     for name, proc in processes:
@@ -220,7 +2281,8 @@ def build_extraction_pipeline(config, is_uploaded_file=False):
     return processes
 
 def generate_backup_filename(config):
-    date_str = datetime.now().strftime('%d_%b').upper()
+    # The name is the catalog key, so it carries the year and time: a second backup the same day must not replace the first.
+    date_str = datetime.now().strftime('%d_%b_%Y_%H%M%S').upper()
     sources = set(config.get('sources', []))
     termux_map = {HOME_DIR: "HOME", PREFIX_DIR: "USR"}
     termux_descriptors = sorted([name for path, name in termux_map.items() if path in sources])
@@ -229,6 +2291,8 @@ def generate_backup_filename(config):
     if termux_descriptors: storage_parts.append(f"TERMUX({'/'.join(termux_descriptors)})")
     if has_custom_paths: storage_parts.append("CUSTOM")
     storage_type_str = "+".join(storage_parts) or "EMPTY"
+    if config.get('backupType') == 'incremental': storage_type_str += "_INC"
+    elif config.get('backupType') == 'synthetic': storage_type_str += "_SYN"
     base_filename = f"{date_str}_{storage_type_str}.tar.zst"
     if str(config.get('encrypt')).lower() == 'true':
         if config.get('encryptionMethod') == 'age': base_filename += ".age"
@@ -236,54 +2300,230 @@ def generate_backup_filename(config):
     return base_filename
 
 def run_backup_task(config, destination_stream):
-    pipeline_success, processes, failed_files = False, [], []
+    pipeline_success, processes, failed_files, report = False, [], [], None
+    started, bytes_out, writer, start_ms = time.time(), 0, None, None
+    cpu_start, _ = job_resources(reset_peak=True)
     output_path = destination_stream.name if hasattr(destination_stream, 'name') else "browser_stream"
+    if getattr(destination_stream, 'negotiated_level', None): config = {**config, 'compressionLevel': destination_stream.negotiated_level}
     try:
         final_stream, processes, error_event, failed_files = build_backup_pipeline(config)
-        with final_stream as pipe:
-            while not error_event.is_set():
-                chunk = pipe.read(8192)
-                if not chunk: break
-                destination_stream.write(chunk)
-        if error_event.is_set(): raise RuntimeError("Backup aborted due to critical error.")
+        writer = dict(processes)['archive']; report = writer.failure_summary; ACTIVE_JOBS.add(error_event)
+        with final_stream as pipe:  # every destination copies or writes the block before returning
+            if pipe.peek(1): start_ms = (time.time() - started) * 1000; log_debug(f"First archive byte after {start_ms:.0f} ms")
+            bytes_out = copy_stream(pipe, destination_stream.write, error_event)
+        if error_event.is_set(): raise RuntimeError(f"Backup aborted: {error_event.reason}")
         exit_codes = {name: proc.wait() for name, proc in processes}
-        tar_code = exit_codes.get('tar', 0)
-        other_codes_ok = all(code == 0 for name, code in exit_codes.items() if name != 'tar')
-        if (tar_code in [0, 1]) and other_codes_ok:
+        archive_code = exit_codes.get('archive', 0)
+        other_codes_ok = all(code == 0 for name, code in exit_codes.items() if name != 'archive')
+        if (archive_code in [0, 1]) and other_codes_ok:
+            if hasattr(destination_stream, 'finalize'): destination_stream.finalize()
             pipeline_success = True
-            if tar_code == 1: log_event("tar finished with warnings.", "warn")
+            if config.get('archiveName'): catalog_finish(config['archiveName'], True, output_path)
+            if archive_code == 1: log_event(f"Archive finished with {len(failed_files)} skipped entries.", "warn")
             log_event("Backup task completed successfully!", 'success')
-            socketio.emit('backup_complete', {'status': 'success', 'failed_files': failed_files})
+            log_event(f"Pipeline start latency: {start_ms or 0:.0f} ms to the first archive byte.", "info")
+            socketio.emit('backup_complete', {'status': 'success', 'failed_files': failed_files, 'report': report(), 'start_ms': round(start_ms or 0)})
         else: raise RuntimeError(f"Backup failed. Exit codes: {exit_codes}")
     except Exception as e:
         log_event(f"A critical error occurred: {e}", 'error')
-        socketio.emit('backup_complete', {'status': 'error', 'failed_files': failed_files})
+        socketio.emit('backup_complete', {'status': 'error', 'failed_files': failed_files, 'report': report() if report else None})
     finally:
-        if not pipeline_success and output_path != "browser_stream" and os.path.exists(output_path):
+        if not pipeline_success and hasattr(destination_stream, 'abort'): destination_stream.abort()
+        elif not pipeline_success and output_path != "browser_stream" and os.path.exists(output_path):
             os.remove(output_path); log_event("Removed incomplete file.", 'warn')
-        for _, proc in processes:
-            if proc.poll() is None: proc.terminate()
-            proc.wait()
+        stop_stages(processes)
+        if writer:
+            ACTIVE_JOBS.discard(writer.error_event)
+            cpu_end, rss_kb = job_resources(); duration = max(time.time() - started, 1e-3)
+            record_job('backup', config.get('archiveName'), started, writer.files_written, writer.bytes_written, bytes_out,
+                       compression_level(config) or 3, 'success' if pipeline_success else 'error', profile=config.get('profile'), start_ms=start_ms,
+                       cpu_s=cpu_end - cpu_start, rss_kb=rss_kb, temp_c=device_temperature(), blocked=min(writer.write_wait / duration, 1.0))
+            if pipeline_success: learn_eta_model(writer)
+        if not pipeline_success and config.get('archiveName'): catalog_finish(config['archiveName'], False)
+
+def delta_patch_file(src, dest_path, size):
+    # The archive already holds the new bytes locally, so each block is compared against the
+    # same offset of the existing file and only differing blocks are written back in place.
+    blocks_written = blocks_total = offset = 0
+    with open(dest_path, 'r+b', buffering=0) as dest:
+        while offset < size:
+            new = src.read(min(DELTA_BLOCK_SIZE, size - offset))
+            if not new: raise EOFError(f"Archive ended inside '{dest_path}'.")
+            old = dest.read(len(new)); blocks_total += 1
+            if old != new: dest.seek(offset); dest.write(new); blocks_written += 1
+            offset += len(new)
+        dest.truncate(size)
+    return blocks_written, blocks_total
+
+def within_restore_root(root, name):
+    # Absolute or ../ member names, and directories that are symlinks extracted earlier, must not lead outside `root`.
+    # The last component may be a link; callers do not write through it.
+    real_root = os.path.realpath(root); dest = os.path.join(real_root, name)
+    return path_within(os.path.join(os.path.realpath(os.path.dirname(dest)), os.path.basename(dest)), [real_root])
+
+def run_delta_extraction(stream, config):
+    root = config.get('targetDir') or os.getcwd()
+    show_progress = str(config.get('showFileProgress')).lower() == 'true'
+    extract_args = {'filter': 'tar'} if hasattr(tarfile, 'tar_filter') else {}
+    stats = {'unchanged': 0, 'patched': 0, 'rewritten': 0, 'blocks_written': 0, 'blocks_total': 0}; dir_times = []
+    strict = durability_mode(config) == 'strict'
+    with tarfile.open(fileobj=stream, mode='r|', copybufsize=OUTPUT_BLOCK_SIZE) as archive:
+        for member in archive:
+            if member.name.startswith(BLOCKS_PREFIX): raise RuntimeError("This is an incremental archive without its catalog; restore it on the device that made it.")
+            if not within_restore_root(root, member.name):
+                log_event(f"Skipped '{member.name}': it would be written outside the restore target.", "warn"); continue
+            dest = os.path.join(root, member.name)
+            if show_progress: socketio.emit('file_processed', {'filename': member.name})
+            if member.isfile() and os.path.isfile(dest) and not os.path.islink(dest):
+                st = os.stat(dest)
+                if st.st_size == member.size and int(st.st_mtime) == int(member.mtime):
+                    stats['unchanged'] += 1; continue
+                if max(st.st_size, member.size) >= DELTA_MIN_SIZE:
+                    written, total = delta_patch_file(archive.extractfile(member), dest, member.size)
+                    os.chmod(dest, member.mode); os.utime(dest, (member.mtime, member.mtime))
+                    if strict and written: fsync_path(dest)
+                    stats['patched'] += 1; stats['blocks_written'] += written; stats['blocks_total'] += total; continue
+            if member.isdir(): dir_times.append((dest, member.mtime))
+            archive.extract(member, root, **extract_args); stats['rewritten'] += 1
+            if strict and member.isfile(): fsync_path(dest)
+    while stream.read(1024 * 1024): pass  # drain tar record padding so zstd exits cleanly
+    for path, mtime in reversed(dir_times):
+        try: os.utime(path, (mtime, mtime))
+        except OSError: pass
+    log_event(f"Delta restore: {stats['unchanged']} unchanged, {stats['rewritten']} written, {stats['patched']} patched "
+              f"({stats['blocks_written']}/{stats['blocks_total']} blocks rewritten).", "info")
+    return stats
+
+def finish_restore_writes(config):
+    # One filesystem sync per restore instead of one per file ('strict' delta/chain restores also synced each file).
+    if durability_mode(config) == 'fast': return
+    started = time.monotonic(); sync_filesystem(config.get('targetDir') or os.getcwd())
+    log_debug(f"Restore synced in {time.monotonic() - started:.2f}s")
 
 def run_extraction_task(config, is_uploaded_file=False):
     temp_file = os.path.join(TEMP_UPLOAD_PATH, config.get('filename')) if is_uploaded_file else None
+    processes = []; token = CancelToken(); ACTIVE_JOBS.add(token)
     try:
-        processes = build_extraction_pipeline(config, is_uploaded_file)
-        _, final_proc = processes[-1]; final_proc.wait()
+        with catalog_connect() as conn: archive_row = catalog_archive(conn, config.get('filename'))
+        if archive_row is None and re.search(r'_INC(\d{6})?\.tar', config.get('filename') or ''):
+            raise RuntimeError(f"'{config.get('filename')}' is an incremental archive and this catalog has no record of its chain; "
+                               "restore it on the device that made it, or restore its full backup instead.")
+        if archive_row is not None and archive_row['kind'] == 'incremental':
+            run_chain_restore(archive_row, config, is_uploaded_file, token=token); finish_restore_writes(config)
+            socketio.emit('extraction_complete', {'status': 'success'}); return
+        blocks_dir = os.path.join(config.get('targetDir') or os.getcwd(), BLOCKS_PREFIX); had_blocks = os.path.exists(blocks_dir)
+        processes = build_extraction_pipeline(config, is_uploaded_file); abort_on_cancel(token, processes, "Restore")
+        _, final_proc = processes[-1]
+        if config.get('restoreMode') == 'delta':
+            with final_proc.stdout as stream: run_delta_extraction(stream, config)
+        final_proc.wait()
         exit_codes = {name: proc.wait() for name, proc in processes}
+        if token.is_set(): raise RuntimeError(f"Restore aborted: {token.reason}")
+        if not had_blocks and os.path.isdir(blocks_dir):  # renamed incremental: its block deltas are not usable files
+            shutil.rmtree(blocks_dir, ignore_errors=True)
+            raise RuntimeError("This is an incremental archive without its catalog; changed blocks of large files could not be applied.")
         if all(code == 0 for code in exit_codes.values()):
-            log_event("Extraction completed successfully!", 'success')
+            finish_restore_writes(config); log_event("Extraction completed successfully!", 'success')
             socketio.emit('extraction_complete', {'status': 'success'})
         else:
             log_event(f"Extraction failed. Exit codes: {exit_codes}", 'error')
             socketio.emit('extraction_complete', {'status': 'error'})
     except Exception as e:
-        log_event(f"A critical error during extraction: {e}", 'error')
+        if token.is_set(): log_event(f"Restore aborted: {token.reason}.", 'warn')  # torn-down stages surface as read errors
+        else: log_event(f"A critical error during extraction: {e}", 'error')
         socketio.emit('extraction_complete', {'status': 'error'})
     finally:
+        stop_stages(processes); ACTIVE_JOBS.discard(token)
         if temp_file and os.path.exists(temp_file):
             os.remove(temp_file); log_event("Cleaned up temporary file.", "info")
 
+# --- Static Assets ---
+def fetch_vendor_assets():
+    import urllib.request
+    for rel, url in VENDOR_ASSETS.items():
+        dest = os.path.join(VENDOR_PATH, rel); os.makedirs(os.path.dirname(dest), exist_ok=True)
+        with urllib.request.urlopen(url, timeout=30) as resp, open(dest + ".part", "wb") as f: shutil.copyfileobj(resp, f)
+        os.replace(dest + ".part", dest); print(f"  {rel}")
+
+def write_fingerprinted(name, ext, data, produced):
+    fname = f"{name}.{hashlib.sha256(data).hexdigest()[:12]}{ext}"; path = os.path.join(DIST_PATH, fname)
+    if not os.path.exists(path):
+        variants = [("", data)]
+        if ext in ('.css', '.js', '.svg', '.ttf'):  # woff2/png/gif are already compressed
+            variants.append((".gz", gzip.compress(data, compresslevel=9)))
+            if brotli: variants.append((".br", brotli.compress(data, quality=11)))
+            if zstandard: variants.append((".zst", zstandard.ZstdCompressor(level=19).compress(data)))
+        for suffix, body in variants:
+            with open(path + suffix + ".part", "wb") as f: f.write(body)
+            os.replace(path + suffix + ".part", path + suffix)
+    produced.add(fname); return f"/assets/{fname}"
+
+def bundle_css(produced):
+    def rewrite(source):
+        # Fonts/images referenced by relative url() are fingerprinted too, so the bundle can live anywhere.
+        base = os.path.dirname(os.path.join(STATIC_PATH, source))
+        def repl(m):
+            ref = m.group(2); target = os.path.normpath(os.path.join(base, ref.split('?')[0].split('#')[0]))
+            if re.match(r'^(data:|[a-z]+:|/|#)', ref) or not os.path.isfile(target): return m.group(0)
+            name, ext = os.path.splitext(os.path.basename(target))
+            with open(target, 'rb') as f: return f"url({write_fingerprinted(name, ext, f.read(), produced)})"
+        with open(os.path.join(STATIC_PATH, source), encoding='utf-8') as f:
+            return re.sub(r'url\(\s*([\'"]?)([^\'")]+)\1\s*\)', repl, f.read())
+    return "\n".join(rewrite(source) for source in ASSET_CSS).encode()
+
+def bundle_js():
+    # Concatenated as is: regex minifiers mangle template literals and strings holding '//', and the
+    # precompressed variants recover most of what minifying would save.
+    parts = []
+    for source in ASSET_JS:
+        with open(os.path.join(STATIC_PATH, source), encoding='utf-8') as f: parts.append(f.read())
+    return ";\n".join(parts).encode()
+
+def build_assets():
+    """(Re)build the fingerprinted bundle when a source changed; None while the vendor files are missing,
+    in which case the page falls back to the CDN links."""
+    global ASSET_BUNDLE
+    sources = [os.path.join(STATIC_PATH, rel) for rel in ASSET_CSS + ASSET_JS] + [os.path.join(VENDOR_PATH, rel) for rel in VENDOR_ASSETS]
+    try: key = [(path, os.stat(path).st_mtime_ns) for path in sources]
+    except OSError: return None
+    with ASSET_LOCK:
+        if ASSET_BUNDLE and ASSET_BUNDLE['key'] == key: return ASSET_BUNDLE
+        os.makedirs(DIST_PATH, exist_ok=True); produced = set()
+        bundle = {'key': key, 'css': write_fingerprinted("bundle", ".css", bundle_css(produced), produced),
+                  'js': write_fingerprinted("bundle", ".js", bundle_js(), produced)}
+        for fname in os.listdir(DIST_PATH):  # drop superseded builds, their variants and interrupted writes
+            if fname.endswith('.part') or re.sub(r'\.(gz|br|zst)$', '', fname) not in produced:
+                try: os.remove(os.path.join(DIST_PATH, fname))
+                except OSError: pass
+        ASSET_BUNDLE = bundle; return bundle
+
+def task_build_assets():
+    try:
+        if not build_assets(): print(f"\n  {TermColors.WARNING}Vendor assets missing, using CDN. Run with --fetch-assets once.{TermColors.ENDC}")
+    except Exception as e: print(f"\n  {TermColors.WARNING}Asset build failed, using unbundled files: {e}{TermColors.ENDC}")
+    return True
+
+@app.context_processor
+def asset_urls():
+    try: bundle = build_assets()
+    except Exception: bundle = None
+    if bundle: return {'asset_css': [bundle['css']], 'asset_js': [bundle['js']], 'assets_from_cdn': False}
+    return {'assets_from_cdn': True, 'asset_css': [VENDOR_ASSETS[rel[len('vendor/'):]] if rel.startswith('vendor/') else f"/static/{rel}" for rel in ASSET_CSS],
+            'asset_js': [VENDOR_ASSETS[rel[len('vendor/'):]] if rel.startswith('vendor/') else f"/static/{rel}" for rel in ASSET_JS]}
+
+@app.route('/assets/<filename>')
+def serve_asset(filename):
+    # Names carry a content hash, so any cached copy is valid forever; pick the best precompressed variant.
+    if filename.startswith('.'): return "Not found", 404
+    encoding = negotiate_encoding(request.headers.get('Accept-Encoding', ''))
+    suffix = {'zstd': '.zst', 'br': '.br', 'gzip': '.gz'}.get(encoding)
+    if not suffix or not os.path.isfile(os.path.join(DIST_PATH, filename + suffix)): suffix = encoding = None
+    mimetype = mimetypes.guess_type(filename)[0] or 'application/octet-stream'
+    response = send_from_directory(DIST_PATH, filename + (suffix or ''), mimetype=mimetype, max_age=ASSET_MAX_AGE)
+    if encoding: response.headers['Content-Encoding'] = encoding
+    response.headers['Cache-Control'] = f'public, max-age={ASSET_MAX_AGE}, immutable'; response.vary.add('Accept-Encoding')
+    return response
+
 # --- Flask Routes & Startup ---
 @app.route('/')
 def index(): return render_template('index.html')
@@ -327,13 +2567,18 @@ def task_pre_cache_root_nodes():
                 "icon": root["icon"], "children": True})
     ROOT_NODE_CACHE = nodes; ROOT_NODE_CACHE_TIME = time.time()
 
-@app.route('/api/get_tree_node')
-def get_tree_node():
-    path = request.args.get('path', '#')
-    if path == '#': return jsonify(ROOT_NODE_CACHE or [])
+def list_tree_children(path):
+    """jsTree nodes for one directory and the directory's mtime, None when the nodes are an error
+    placeholder that must not be cached. Listings are reused until the directory's mtime changes,
+    i.e. until an entry is added or removed."""
+    try: mtime_ns = os.stat(path).st_mtime_ns
+    except OSError as e: return [{"text": f"Error: {e}", "icon": "fa fa-exclamation-triangle"}], None
+    with DIR_CACHE_LOCK:
+        cached = DIR_CACHE.get(path)
+        if cached and cached[0] == mtime_ns: DIR_CACHE.move_to_end(path); return cached[1], mtime_ns
     nodes = []
     try:
-        if not os.access(path, os.R_OK): return jsonify([{"text": "Permission Denied", "icon": "fa fa-lock"}])
+        if not os.access(path, os.R_OK): return [{"text": "Permission Denied", "icon": "fa fa-lock"}], None
         for entry in sorted(os.listdir(path), key=str.lower):
             full_path = os.path.join(path, entry)
             if not os.path.lexists(full_path) or not os.access(full_path, os.R_OK): continue
@@ -343,113 +2588,300 @@ def get_tree_node():
             else:
                 node["icon"], node["children"] = "fa fa-file", False
             nodes.append(node)
-    except Exception as e: return jsonify([{"text": f"Error: {e}", "icon": "fa fa-exclamation-triangle"}])
-    return jsonify(nodes)
+    except Exception as e: return [{"text": f"Error: {e}", "icon": "fa fa-exclamation-triangle"}], None
+    with DIR_CACHE_LOCK:
+        DIR_CACHE[path] = (mtime_ns, nodes)
+        while len(DIR_CACHE) > DIR_CACHE_MAX: DIR_CACHE.popitem(last=False)
+    return nodes, mtime_ns
+
+def response_cache_get(key):
+    with RESPONSE_CACHE_LOCK:
+        body = RESPONSE_CACHE.get(key)
+        if body is not None: RESPONSE_CACHE.move_to_end(key)
+        return body
+
+def response_cache_put(key, body):
+    with RESPONSE_CACHE_LOCK:
+        RESPONSE_CACHE[key] = body
+        while len(RESPONSE_CACHE) > RESPONSE_CACHE_MAX: RESPONSE_CACHE.popitem(last=False)
+
+def cached_json_response(build, validators):
+    """JSON response with a weak ETag derived from `validators` (mtimes, sizes...). A matching
+    If-None-Match gets a 304 without calling `build`; otherwise the serialized body is reused
+    while the validators are unchanged. Weak, so one tag covers every Content-Encoding."""
+    etag = hashlib.blake2b(json.dumps(validators).encode(), digest_size=12).hexdigest()
+    if request.if_none_match.contains_weak(etag): response = Response(status=304)
+    else:
+        body = response_cache_get((etag, 'identity'))
+        if body is None: body = json.dumps(build(), separators=(',', ':')).encode(); response_cache_put((etag, 'identity'), body)
+        response = Response(body, mimetype='application/json')
+    response.set_etag(etag, weak=True); response.headers['Cache-Control'] = 'private, no-cache'
+    return response
+
+def negotiate_encoding(accept_encoding):
+    offered = {}
+    for part in accept_encoding.split(','):
+        name, _, params = part.strip().partition(';')
+        q = re.search(r'q=([\d.]+)', params); offered[name.strip().lower()] = float(q.group(1)) if q else 1.0
+    for encoding, available in (('zstd', zstandard), ('br', brotli), ('gzip', gzip)):
+        if available and offered.get(encoding, 0) > 0: return encoding
+    return None
+
+def compress_body(body, encoding):
+    if encoding == 'zstd': return zstandard.ZstdCompressor(level=3).compress(body)
+    if encoding == 'br': return brotli.compress(body, quality=5)
+    return gzip.compress(body, compresslevel=6)
+
+@app.after_request
+def compress_json_response(response):
+    if response.status_code != 200 or response.direct_passthrough or response.mimetype != 'application/json' or 'Content-Encoding' in response.headers:
+        return response
+    response.vary.add('Accept-Encoding')
+    encoding = negotiate_encoding(request.headers.get('Accept-Encoding', ''))
+    body = response.get_data()
+    if not encoding or len(body) < COMPRESS_MIN_SIZE: return response
+    etag, _ = response.get_etag(); key = (etag, encoding)
+    compressed = response_cache_get(key) if etag else None
+    if compressed is None:
+        compressed = compress_body(body, encoding)
+        if etag: response_cache_put(key, compressed)
+    response.set_data(compressed); response.headers['Content-Encoding'] = encoding
+    return response
+
+@app.route('/api/get_tree_node')
+def get_tree_node():
+    path = request.args.get('path', '#')
+    if path == '#': return cached_json_response(lambda: ROOT_NODE_CACHE or [], ['#', ROOT_NODE_CACHE_TIME])
+    nodes, mtime_ns = list_tree_children(path)
+    if mtime_ns is None: return jsonify(nodes)  # errors may be transient: no ETag, so the next request retries
+    return cached_json_response(lambda: nodes, [path, mtime_ns])
+
+@app.route('/api/get_tree_nodes')
+def get_tree_nodes():
+    """Children of several paths in one round trip; with depth > 1 the children of each
+    returned directory are included too, so the client can expand them without asking."""
+    try: depth = min(max(int(request.args.get('depth', 1)), 1), TREE_BATCH_MAX_DEPTH)
+    except ValueError: depth = 1
+    pending = [(path, 1) for path in request.args.getlist('path')]; result, validators, count = {}, [], 0
+    while pending and count < TREE_BATCH_MAX_NODES:
+        path, level = pending.pop(0)
+        if path in result: continue
+        if path == '#': nodes, mtime_ns = ROOT_NODE_CACHE or [], ROOT_NODE_CACHE_TIME
+        else: nodes, mtime_ns = list_tree_children(path)
+        result[path] = nodes; validators.append([path, mtime_ns]); count += len(nodes)
+        if level < depth: pending.extend((node['id'], level + 1) for node in nodes if node.get('children') is True)
+    if any(mtime_ns is None for _, mtime_ns in validators): return jsonify({'nodes': result})  # an error listing: never cached
+    return cached_json_response(lambda: {'nodes': result}, validators)
+
+@app.route('/api/file_versions')
+def get_file_versions():
+    query = request.args.get('q', '').strip()
+    if len(query) < 2: return jsonify({"error": "Type at least two characters."}), 400
+    return jsonify(file_versions(query))
+
+@app.route('/api/restore_file', methods=['POST'])
+def restore_file():
+    config = request.json or {}
+    if not config.get('archive') or not config.get('rel'): return jsonify({"error": "Archive and path are required."}), 400
+    threading.Thread(target=run_file_restore_task, args=(config['archive'], config['rel'], bool(config.get('inPlace')), config), daemon=True).start()
+    return jsonify({"status": "File restore started."})
+
+@app.route('/api/search_files')
+def search_files():
+    query = request.args.get('q', '').strip(); started = time.monotonic()
+    if not query: return jsonify({'results': [], 'indexed': 0, 'ms': 0})
+    try: limit = min(max(int(request.args.get('limit', FILE_SEARCH_LIMIT)), 1), 1000)
+    except ValueError: limit = FILE_SEARCH_LIMIT
+    results, indexed = search_file_index(query, limit)
+    return jsonify({'results': results, 'indexed': indexed, 'refreshing': FILE_INDEX_LOCK.locked(), 'ms': round((time.monotonic() - started) * 1000, 1)})
+
+def run_local_backup_job(config):
+    try:
+        if str(config.get('backupSubdirs')).lower() == 'true':
+            parent_path = config.get('parentPath')
+            log_event(f"Starting individual subdirectory backup for '{parent_path}'...")
+            os.makedirs(BACKUPS_PATH, exist_ok=True)
+            subdirs = [d for d in sorted(os.listdir(parent_path)) if os.path.isdir(os.path.join(parent_path, d))]
+            if not subdirs:
+                log_event(f"No subdirectories found in '{os.path.basename(parent_path)}'.", "warn")
+                socketio.emit('backup_complete', {'status': 'success'}); return
+            total, completed = len(subdirs), 0
+            for i, subdir_name in enumerate(subdirs):
+                log_event(f"[{i+1}/{total}] Backing up: {subdir_name}")
+                subdir_config = {k: v for k, v in config.items() if k != 'parentPath'}
+                subdir_config['sources'] = [os.path.join(parent_path, subdir_name)]
+                subdir_config['archiveName'] = f"{secure_filename(subdir_name) or 'DIR'}_{generate_backup_filename(subdir_config)}"
+                with open_destination(subdir_config, subdir_config['archiveName']) as f:
+                    run_backup_task(subdir_config, f)
+                completed += 1
+            log_event(f"Subdirectory backup complete. {completed}/{total} archives created.", 'success')
+            socketio.emit('backup_complete', {'status': 'success'})
+        else:
+            config['archiveName'] = generate_backup_filename(config)
+            with open_destination(config, config['archiveName']) as f:
+                log_event(f"Saving to: {f.name}", 'info'); run_backup_task(config, f)
+    except Exception as e:
+        log_event(f"Error in backup thread: {e}", "error")
+        socketio.emit('backup_complete', {'status': 'error'})
 
 @app.route('/start_local_backup', methods=['POST'])
 def start_local_backup():
-    config = request.json
-    def task_wrapper(config):
-        try:
-            if str(config.get('backupSubdirs')).lower() == 'true':
-                parent_path = config.get('parentPath')
-                log_event(f"Starting individual subdirectory backup for '{parent_path}'...")
-                os.makedirs(BACKUPS_PATH, exist_ok=True)
-                subdirs = [d for d in sorted(os.listdir(parent_path)) if os.path.isdir(os.path.join(parent_path, d))]
-                if not subdirs:
-                    log_event(f"No subdirectories found in '{os.path.basename(parent_path)}'.", "warn")
-                    socketio.emit('backup_complete', {'status': 'success'}); return
-                total, completed = len(subdirs), 0
-                for i, subdir_name in enumerate(subdirs):
-                    log_event(f"[{i+1}/{total}] Backing up: {subdir_name}")
-                    subdir_config = {k: v for k, v in config.items() if k != 'parentPath'}
-                    subdir_config['sources'] = [os.path.join(parent_path, subdir_name)]
-                    filename = generate_backup_filename(subdir_config)
-                    output_path = os.path.join(BACKUPS_PATH, filename)
-                    with open(output_path, "wb") as f:
-                        run_backup_task(subdir_config, f)
-                    completed += 1
-                log_event(f"Subdirectory backup complete. {completed}/{total} archives created.", 'success')
-                socketio.emit('backup_complete', {'status': 'success'})
-            else:
-                filename = generate_backup_filename(config)
-                output_path = os.path.join(BACKUPS_PATH, filename)
-                os.makedirs(BACKUPS_PATH, exist_ok=True)
-                log_event(f"Saving to: {output_path}", 'info')
-                with open(output_path, "wb") as f: run_backup_task(config, f)
-        except Exception as e:
-            log_event(f"Error in backup thread: {e}", "error")
-            socketio.emit('backup_complete', {'status': 'error'})
-    threading.Thread(target=task_wrapper, args=(config,), daemon=True).start()
+    try: config = resolve_selection(request.json or {})
+    except ValueError as e: return jsonify({"error": str(e)}), 400
+    threading.Thread(target=run_local_backup_job, args=(config,), daemon=True).start()
     return jsonify({"status": "Local backup started."})
 
 @app.route('/download_backup')
 def download_backup():
     config = {k: v for k, v in request.args.items()}; config["sources"] = request.args.getlist('source')
+    try: config = resolve_selection(config)
+    except ValueError as e: return f"Error: {e}", 400
     
     if str(config.get('backupSubdirs')).lower() == 'true':
         parent_path = config.get('parentPath')
         date_str = datetime.now().strftime('%d_%b').upper()
         zip_filename = f"{date_str}_{os.path.basename(parent_path)}_Subdirs.zip"
         
+        token = CancelToken(); current = []; ACTIVE_JOBS.add(token); abort_on_cancel(token, current, "Download")
         def generate_zip_stream():
             log_event(f"Starting subdirectory backup to zip for '{os.path.basename(parent_path)}'...")
             subdirs = [d for d in sorted(os.listdir(parent_path)) if os.path.isdir(os.path.join(parent_path, d))]
             zip_buffer = io.BytesIO()
-            with zipfile.ZipFile(zip_buffer, 'w', zipfile.ZIP_DEFLATED) as zip_file:
-                total = len(subdirs)
-                for i, subdir_name in enumerate(subdirs):
-                    log_event(f"[{i+1}/{total}] Compressing '{subdir_name}' and adding to zip...")
-                    subdir_config = {k: v for k, v in config.items() if k != 'parentPath'}
-                    subdir_config['sources'] = [os.path.join(parent_path, subdir_name)]
-                    archive_name = generate_backup_filename(subdir_config)
-                    tar_stream, processes, error_event, _ = build_backup_pipeline(subdir_config)
-                    with tar_stream:
-                        archive_content = tar_stream.read()
-                    for _, proc in processes:
-                        if proc.poll() is None: proc.terminate()
-                        proc.wait()
-                    zip_file.writestr(archive_name, archive_content)
-            log_event("Zip archive created. Starting stream to browser.", 'success')
-            zip_buffer.seek(0); yield zip_buffer.getvalue()
+            try:
+                with zipfile.ZipFile(zip_buffer, 'w', zipfile.ZIP_DEFLATED) as zip_file:
+                    total = len(subdirs)
+                    for i, subdir_name in enumerate(subdirs):
+                        if token.is_set(): return
+                        log_event(f"[{i+1}/{total}] Compressing '{subdir_name}' and adding to zip...")
+                        subdir_config = {k: v for k, v in config.items() if k != 'parentPath'}
+                        subdir_config['sources'] = [os.path.join(parent_path, subdir_name)]
+                        archive_name = generate_backup_filename(subdir_config)
+                        tar_stream, processes, error_event, _ = build_backup_pipeline(subdir_config); current[:] = processes
+                        with tar_stream:
+                            archive_content = tar_stream.read()
+                        stop_stages(processes)
+                        if token.is_set(): return
+                        zip_file.writestr(archive_name, archive_content)
+                log_event("Zip archive created. Starting stream to browser.", 'success')
+                zip_buffer.seek(0); yield zip_buffer.getvalue()
+            except GeneratorExit: log_event("Client disconnected. Cleaning up pipeline...", "info"); raise
+        def cleanup(): stop_stages(current); ACTIVE_JOBS.discard(token)
         headers = {"Content-Disposition": f'attachment; filename="{quote(zip_filename)}"'}
-        return Response(stream_with_context(generate_zip_stream()), headers=headers, content_type='application/zip')
+        response = Response(stream_with_context(generate_zip_stream()), headers=headers, content_type='application/zip')
+        response.call_on_close(cleanup); return response
     else:
         log_event("Request: Stream download.", 'info')
         try:
             final_stream, processes, error_event, _ = build_backup_pipeline(config)
         except (ValueError, PermissionError) as e: return f"Error: {e}", 400
+        ACTIVE_JOBS.add(error_event)  # the writer's CancelToken: /api/cancel_job tears the stages down through it
         def generate_stream():
             try:
                 with final_stream as pipe:
                     while not error_event.is_set():
-                        chunk = pipe.read(8192)
+                        chunk = pipe.read(OUTPUT_BLOCK_SIZE)
                         if not chunk: break
                         yield chunk
-            finally:
-                log_event("Client disconnected. Cleaning up pipeline...", "info")
-                for _, proc in processes:
-                    if proc.poll() is None: proc.terminate()
-                    proc.wait()
+            except GeneratorExit: log_event("Client disconnected. Cleaning up pipeline...", "info"); raise
+            finally: stop_stages(processes); ACTIVE_JOBS.discard(error_event)
+        def cleanup(): stop_stages(processes); ACTIVE_JOBS.discard(error_event)  # also when the body was never iterated
         filename = generate_backup_filename(config)
         headers = {"Content-Disposition": f'attachment; filename="{quote(filename)}"'}
-        return Response(stream_with_context(generate_stream()), headers=headers, content_type='application/octet-stream')
+        response = Response(stream_with_context(generate_stream()), headers=headers, content_type='application/octet-stream')
+        response.call_on_close(cleanup); return response
 
 @app.route('/api/list_backups')
 def list_backups():
     if not os.path.isdir(BACKUPS_PATH): return jsonify([])
     try:
-        backups = []
-        for filename in sorted(os.listdir(BACKUPS_PATH), reverse=True):
-            full_path = os.path.join(BACKUPS_PATH, filename)
-            if not os.path.isfile(full_path): continue
-            try:
-                stat = os.stat(full_path)
-                backups.append({"filename": filename,"size": f"{stat.st_size / 1024 / 1024:.2f} MB","modified": datetime.fromtimestamp(stat.st_mtime).strftime('%Y-%m-%d %H:%M')})
-            except OSError: continue
-        return jsonify(backups)
+        files = []
+        with os.scandir(BACKUPS_PATH) as it:
+            for entry in it:
+                try:
+                    if entry.is_file(): st = entry.stat(); files.append((entry.name, st.st_size, st.st_mtime))
+                except OSError: continue
+        files.sort(reverse=True)
+        build = lambda: [{"filename": name, "size": f"{size / 1024 / 1024:.2f} MB", "modified": datetime.fromtimestamp(mtime).strftime('%Y-%m-%d %H:%M')}
+                         for name, size, mtime in files]
+        return cached_json_response(build, files)  # a backup still being written changes size, hence the tag
     except Exception as e: return jsonify({"error": f"Failed to list backups: {e}"}), 500
 
+@app.route('/api/reports/<name>')
+def get_failure_report(name):
+    # Names come from archive names, which keep characters like '(' that secure_filename would strip;
+    # send_from_directory already refuses anything that leaves REPORTS_PATH.
+    if os.sep in name or (os.altsep and os.altsep in name) or not os.path.isfile(os.path.join(REPORTS_PATH, name)): return jsonify({"error": "No such report."}), 404
+    return send_from_directory(REPORTS_PATH, name, mimetype='application/x-ndjson')
+
+@app.route('/api/selection', methods=['POST'])
+def selection_route():
+    data = request.json or {}; include, exclude = data.get('include') or [], data.get('exclude') or []
+    if not all(isinstance(p, str) for p in include + exclude): return jsonify({"error": "Paths must be strings."}), 400
+    try: token, include, exclude = create_selection(include, exclude)
+    except ValueError as e: return jsonify({"error": str(e)}), 400
+    return jsonify({'token': token, 'include': len(include), 'exclude': len(exclude)})
+
+@app.route('/api/plan_backup', methods=['POST'])
+def plan_backup_route():
+    try: return jsonify(plan_backup(resolve_selection(request.json or {})))
+    except (ValueError, OSError) as e: return jsonify({"error": str(e)}), 400
+
+@app.route('/api/job_history')
+def job_history_route():
+    try: limit = min(max(int(request.args.get('limit', JOB_HISTORY_LIMIT)), 1), 5000)
+    except ValueError: limit = JOB_HISTORY_LIMIT
+    try:
+        with catalog_connect() as conn: latest = tuple(conn.execute("SELECT COUNT(*), MAX(id) FROM jobs").fetchone())
+        return cached_json_response(lambda: {'jobs': job_history(limit)}, ['jobs', limit, *latest])
+    except sqlite3.Error as e: return jsonify({"error": str(e)}), 500
+
+@app.route('/api/estimate_compression', methods=['POST'])
+def estimate_compression_route():
+    try: pruned = prune_redundant_paths(resolve_selection(request.json or {}).get('sources', []))
+    except ValueError as e: return jsonify({"error": str(e)}), 400
+    if not pruned: return jsonify({"error": "No source directories selected."}), 400
+    ESTIMATE_CACHE.pop(catalog_sources_key(pruned), None)
+    return jsonify({'curve': estimate_for_sources(pruned)})
+
+@app.route('/api/profiles')
+def list_profiles(): return jsonify({'profiles': load_profiles(), 'plans': WARM_PLANS})
+
+@app.route('/api/profiles', methods=['POST'])
+def save_profile():
+    data = request.json or {}; name = (data.get('name') or '').strip()[:64]
+    if not name: return jsonify({"error": "Profile name is required."}), 400
+    try: data = resolve_selection(data)  # profiles keep the concrete paths, tokens are not persistent
+    except ValueError as e: return jsonify({"error": str(e)}), 400
+    if not prune_redundant_paths(data.get('sources', [])): return jsonify({"error": "A profile needs at least one source."}), 400
+    profile = {k: data.get(k) for k in PROFILE_FIELDS}  # passphrases are never stored
+    with PROFILES_LOCK:
+        profiles = load_profiles(); profile['lastRun'] = profiles.get(name, {}).get('lastRun'); profiles[name] = profile; save_profiles(profiles)
+    threading.Thread(target=warm_profile, args=(name, profile), daemon=True).start()
+    return jsonify({"status": f"Profile '{name}' saved."})
+
+@app.route('/api/profiles/<name>', methods=['DELETE'])
+def delete_profile(name):
+    with PROFILES_LOCK:
+        profiles = load_profiles()
+        if profiles.pop(name, None) is None: return jsonify({"error": "Profile not found."}), 404
+        save_profiles(profiles)
+    WARM_PLANS.pop(name, None)
+    return jsonify({"status": f"Profile '{name}' deleted."})
+
+@app.route('/api/profiles/<name>/run', methods=['POST'])
+def run_profile_route(name):
+    if ACTIVE_JOBS: return jsonify({"error": "Another job is running."}), 409
+    try: run_profile(name)
+    except KeyError: return jsonify({"error": "Profile not found."}), 404
+    except ValueError as e: return jsonify({"error": str(e)}), 400
+    return jsonify({"status": f"Profile '{name}' started."})
+
+@app.route('/api/cancel_job', methods=['POST'])
+def cancel_job():
+    jobs = list(ACTIVE_JOBS)
+    for token in jobs: token.cancel("Cancelled by user")
+    return jsonify({"status": f"Cancelling {len(jobs)} job(s)."})
+
 @app.route('/api/delete_backup', methods=['POST'])
 def delete_backup():
     data = request.json; filename = data.get('filename')
@@ -463,6 +2895,23 @@ def delete_backup():
         else: return jsonify({"error": "File not found."}), 404
     except Exception as e: return jsonify({"error": str(e)}), 500
 
+@app.route('/api/push_backup', methods=['POST'])
+def push_backup():
+    config = request.json or {}; filename = secure_filename(config.get('filename', ''))
+    source_path = os.path.join(BACKUPS_PATH, filename)
+    if not filename or not os.path.isfile(source_path): return jsonify({"error": "File not found."}), 404
+    def push_task():
+        try:
+            with SftpUpload(sftp_remote_path(config, filename), config.get('sftpPort') or 22, resume=True) as remote, open(source_path, 'rb') as f:
+                remote.resume_from(f)
+                for chunk in iter(lambda: f.read(1024 * 1024), b''): remote.write(chunk)
+                remote.finalize()
+            socketio.emit('backup_complete', {'status': 'success'})
+        except Exception as e:
+            log_event(f"Push of {filename} failed: {e}", "error"); socketio.emit('backup_complete', {'status': 'error'})
+    threading.Thread(target=push_task, daemon=True).start()
+    return jsonify({"status": f"Pushing {filename}."})
+
 @app.route('/upload_and_extract', methods=['POST'])
 def upload_and_extract():
     if 'backupFile' not in request.files: return jsonify({"error": "No file part"}), 400
@@ -476,6 +2925,17 @@ def upload_and_extract():
         return jsonify({"status": "Upload successful, extraction started."})
     except Exception as e: return jsonify({"error": str(e)}), 500
 
+@app.route('/api/peer/listen', methods=['POST'])
+def peer_listen():
+    # Only the receiver's own options: anything else (restoreMode, ...) would change how the stream is unpacked.
+    config = {k: (request.json or {}).get(k) for k in ('showFileProgress', 'targetDir')}; token = secrets.token_hex(6).upper()
+    try: server = socket.create_server((HOST, PEER_PORT))
+    except OSError as e: return jsonify({"error": f"Cannot listen on port {PEER_PORT}: {e}"}), 409
+    threading.Thread(target=run_peer_receive_task, args=(server, token, config), daemon=True).start()
+    address = f"{get_lan_ip()}:{PEER_PORT}"
+    log_event(f"Waiting for a peer at {address} with pairing code {token}.", "info")
+    return jsonify({"address": address, "token": token})
+
 @app.route('/start_extraction', methods=['POST'])
 def start_extraction():
     config = request.json
@@ -495,7 +2955,7 @@ def run_with_spinner(task, message="Processing..."):
     else: print(f"{TermColors.BOLD}{message}{TermColors.ENDC} {TermColors.FAIL}[FAILED]{TermColors.ENDC}\n  {TermColors.WARNING}Reason: {final_result}{TermColors.ENDC}"); sys.exit(1)
 
 def task_check_dependencies():
-    deps = {'tar': TAR_BIN, 'zstd': ZSTD_BIN, 'pv': PV_BIN, 'gnupg': GPG_BIN, 'age': AGE_BIN, 'termux-api': WAKELOCK_BIN}
+    deps = {'tar': TAR_BIN, 'zstd': ZSTD_BIN, 'gnupg': GPG_BIN, 'age': AGE_BIN, 'termux-api': WAKELOCK_BIN}
     missing = [name for name, path in deps.items() if not shutil.which(path)]
     if missing: return f"Missing dependencies: {', '.join(missing)}."
     return True
@@ -542,13 +3002,19 @@ def generate_and_display_qr(url):
 
 if __name__ == '__main__':
     log = logging.getLogger('werkzeug'); log.setLevel(logging.ERROR)
+    if '--fetch-assets' in sys.argv:
+        print(f"Fetching vendor assets into {VENDOR_PATH}..."); fetch_vendor_assets(); build_assets(); sys.exit(0)
     
     print(f"{TermColors.HEADER}{TermColors.BOLD}--- Termux Web Backup Suite ---{TermColors.ENDC}")
     run_with_spinner(task_check_dependencies, "Checking dependencies...")
     run_with_spinner(task_check_storage_access, "Verifying storage access...")
     run_with_spinner(task_acquire_wakelock, "Acquiring wakelock...")
+    run_with_spinner(task_build_assets, "Bundling static assets...")
     
     task_pre_cache_root_nodes()
+    threading.Thread(target=file_index_loop, daemon=True).start()
+    threading.Thread(target=profile_loop, daemon=True).start()
+    ZSTD_POOL.prewarm(compression_level({}) or 3)
 
     print("-" * 30)
 
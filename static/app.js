@@ -10,14 +10,24 @@ $(function () {
         errorHandling: $('#error-handling'),
         gpgOptions: $('#gpg-options'),
         ageOptions: $('#age-options'),
+        destination: $('#destination'),
+        s3Options: $('#s3-options'),
+        sftpOptions: $('#sftp-options'),
+        peerOptions: $('#peer-options'),
         fileTree: $('#file-tree'),
         showFileProgress: $('#show-file-progress'),
+        deltaRestore: $('#delta-restore'),
         backupSubdirsIndividually: $('#backup-subdirs-individually'),
         subdirNote: $('#subdir-note'),
         navRestoreLocal: $('#nav-restore-local'),
         navRestoreUpload: $('#nav-restore-upload'),
+        navRestorePeer: $('#nav-restore-peer'),
         restoreLocalPanel: $('#restore-local-panel'),
         restoreUploadPanel: $('#restore-upload-panel'),
+        restorePeerPanel: $('#restore-peer-panel'),
+        navRestoreVersions: $('#nav-restore-versions'),
+        restoreVersionsPanel: $('#restore-versions-panel'),
+        startPeerReceiveBtn: $('#start-peer-receive-btn'),
         refreshBackupsBtn: $('#refresh-backups-btn'),
         backupTableBody: $('#backup-table-body'),
         uploadFileInput: $('#upload-file-input'),
@@ -32,12 +42,22 @@ $(function () {
         progressText: $('#progress-text'),
         speedIndicator: $('#speed-indicator'),
         etaIndicator: $('#eta-indicator'),
+        progressJobs: $('#progress-jobs'),
+        cancelJobBtn: $('#cancel-job-btn'),
         calculatingModal: $('#calculating-modal'),
     };
 
     // --- State ---
     let isJobRunning = false;
     let isModalVisible = false;
+    const treePrefetch = new Map();      // path -> children received ahead of time in a batch response
+    const treePending = new Map();       // path -> jsTree callbacks waiting for the next batch request
+    let treeFlushScheduled = false;
+    const searchSelections = new Set();  // paths ticked in file search results, added to the tree selection
+    let searchTimer = null;
+    let savedProfiles = {}, warmPlans = {};
+    const progressJobs = new Map();      // job id -> {label, latest decoded progress record}
+    let jobHistory = [];
 
     // --- Screen Wake Lock Manager ---
     const wakeLockManager = {
@@ -61,26 +81,79 @@ $(function () {
 
     // --- Initialization ---
     elements.fileTree.jstree({
-        'core': { 'data': { 'url': '/api/get_tree_node', 'data': (node) => ({ 'path': node.id }) }, 'themes': { 'name': 'default-dark', 'responsive': true } },
+        'core': { 'data': loadTreeNode, 'themes': { 'name': 'default-dark', 'responsive': true } },
         'plugins': ['checkbox']
     });
     loadBackupFiles();
+    loadProfiles();
+    loadJobHistory();
+
+    // Every node jsTree asks for in the same tick goes into one /api/get_tree_nodes request, which
+    // also returns the grandchildren so the next level opens without a round trip.
+    function loadTreeNode(node, callback) {
+        if (treePrefetch.has(node.id)) {
+            callback.call(this, treePrefetch.get(node.id)); treePrefetch.delete(node.id); return;
+        }
+        if (!treePending.has(node.id)) treePending.set(node.id, []);
+        treePending.get(node.id).push(callback.bind(this));
+        if (!treeFlushScheduled) { treeFlushScheduled = true; setTimeout(flushTreeRequests, 0); }
+    }
+
+    function flushTreeRequests() {
+        const waiting = new Map(treePending); treePending.clear(); treeFlushScheduled = false;
+        const params = new URLSearchParams({ depth: 2 });
+        waiting.forEach((_, path) => params.append('path', path));
+        fetch(`/api/get_tree_nodes?${params.toString()}`)
+            .then(response => response.json())
+            .then(data => {
+                Object.entries(data.nodes).forEach(([path, children]) => {
+                    if (waiting.has(path)) waiting.get(path).forEach(callback => callback(children));
+                    else treePrefetch.set(path, children);
+                });
+                waiting.forEach((callbacks, path) => { if (!(path in data.nodes)) callbacks.forEach(callback => callback([])); });
+            })
+            .catch(error => {
+                logToScreen(`Failed to load folders: ${error}`, 'error');
+                waiting.forEach(callbacks => callbacks.forEach(callback => callback([])));
+            });
+    }
 
     // --- Event Handlers ---
     elements.startLocalBtn.on('click', () => startBackup('local'));
+    $('#file-search-input').on('input', () => { clearTimeout(searchTimer); searchTimer = setTimeout(searchFiles, 250); });
+    $('#file-search-results').on('change', 'input', function () {
+        if (this.checked) searchSelections.add(this.value); else searchSelections.delete(this.value);
+        updateSearchStatus();
+    });
     elements.startDownloadBtn.on('click', () => startBackup('download'));
+    $('#plan-backup-btn').on('click', planBackup);
+    $('#load-profile-btn').on('click', applyProfile);
+    $('#save-profile-btn').on('click', saveProfile);
+    $('#run-profile-btn').on('click', runProfile);
+    $('#delete-profile-btn').on('click', deleteProfile);
+    $('#history-metric, #history-profile').on('change', drawJobHistory);
+    $(window).on('resize', drawJobHistory);
+    $('#profile-select').on('change', () => $('#profile-schedule').val((savedProfiles[$('#profile-select').val()] || {}).schedule || ''));
     elements.backupSubdirsIndividually.on('change', function() {
         elements.subdirNote.toggleClass('hidden', !$(this).is(':checked'));
     });
     elements.encryptionMethod.on('change', handleEncryptionMethodChange);
+    elements.destination.on('change', handleDestinationChange);
     elements.navRestoreLocal.on('click', () => switchRestoreTab('local'));
     elements.navRestoreUpload.on('click', () => switchRestoreTab('upload'));
+    elements.navRestorePeer.on('click', () => switchRestoreTab('peer'));
+    elements.navRestoreVersions.on('click', () => switchRestoreTab('versions'));
+    $('#version-search-input').on('input', () => { clearTimeout(searchTimer); searchTimer = setTimeout(searchVersions, 300); });
+    $('#version-results').on('click', '.restore-version-btn', restoreVersion);
     elements.refreshBackupsBtn.on('click', loadBackupFiles);
     elements.backupTableBody.on('change', 'input[name="backup-selection"]', () => handleFileSelectionChange($('input[name="backup-selection"]:checked').val()));
     elements.backupTableBody.on('click', '.delete-btn', handleDeleteClick);
+    elements.backupTableBody.on('click', '.push-btn', handlePushClick);
     elements.uploadFileInput.on('change', () => handleFileSelectionChange(elements.uploadFileInput.val()));
     elements.startExtractionBtn.on('click', startLocalExtraction);
     elements.startUploadBtn.on('click', startUploadExtraction);
+    elements.cancelJobBtn.on('click', cancelJob);
+    elements.startPeerReceiveBtn.on('click', startPeerReceive);
 
     // --- WebSocket Event Listeners ---
     socket.on('connect', () => logToScreen('Connected to backend.', 'info'));
@@ -90,26 +163,46 @@ $(function () {
             $('.modal-content h3').text(data.status_text);
         }
     });
-    socket.on('progress_update', (data) => {
-        hideCalculatingModal();
-        elements.progressBar.css('width', data.percent + '%');
-        elements.progressText.text(data.percent + '%');
-        elements.speedIndicator.html(`<i class="fas fa-bolt"></i> ${data.speed}`);
-        elements.etaIndicator.html(`<i class="fas fa-hourglass-half"></i> ETA: ${data.eta}`);
+    socket.on('progress_jobs', (data) => {
+        Object.entries(data.added || {}).forEach(([id, label]) => progressJobs.set(Number(id), { label, record: null }));
+        (data.removed || []).forEach(id => progressJobs.delete(Number(id)));
+        renderProgress();
+    });
+    socket.on('progress', (buffer) => {
+        // Binary frame from ProgressHub: <BB version, count> then `count` packed <HBQqIIfH> records.
+        const view = new DataView(buffer instanceof ArrayBuffer ? buffer : buffer.buffer.slice(buffer.byteOffset, buffer.byteOffset + buffer.byteLength));
+        if (view.getUint8(0) !== 1) return;
+        for (let i = 0, offset = 2; i < view.getUint8(1); i++, offset += 33) {
+            const id = view.getUint16(offset, true), eta = view.getUint32(offset + 23, true);
+            const job = progressJobs.get(id) || { label: `Job ${id}` };
+            job.record = {
+                state: view.getUint8(offset + 2), bytes: Number(view.getBigUint64(offset + 3, true)),
+                total: Number(view.getBigInt64(offset + 11, true)), files: view.getUint32(offset + 19, true),
+                eta: eta === 0xFFFFFFFF ? null : eta, rate: view.getFloat32(offset + 27, true), blocked: view.getUint16(offset + 31, true) / 10
+            };
+            progressJobs.set(id, job);
+        }
+        hideCalculatingModal(); renderProgress();
+    });
+    socket.on('files_processed', (data) => {
+        // At most a few names per job and tick; the rest of a fast run is summarised as "…".
+        const lines = [];
+        Object.values(data).forEach(({ names, more }) => {
+            names.forEach(filename => lines.push(fileLogLine(filename)));
+            if (more) lines.push('  …\n');
+        });
+        elements.fileLogOutput.append(lines.join(''));
+        elements.fileLogOutput.scrollTop(elements.fileLogOutput[0].scrollHeight);
     });
     socket.on('file_processed', (data) => {
         if (!data || !data.filename) return;
-        const filename = data.filename;
-        const depth = (filename.match(/\//g) || []).length;
-        const indent = ' '.repeat(depth * 2);
-        const basename = filename.substring(filename.lastIndexOf('/') + 1) || filename;
-        const logLine = `${indent}✅ ${basename}\n`;
-        elements.fileLogOutput.append(logLine);
+        elements.fileLogOutput.append(fileLogLine(data.filename));
         elements.fileLogOutput.scrollTop(elements.fileLogOutput[0].scrollHeight);
     });
     socket.on('backup_complete', (data) => {
         hideCalculatingModal();
-        handleJobCompletion(data, 'Backup');
+        if (data.report && data.report.count) logFailureReport(data.report);
+        handleJobCompletion(data, 'Backup'); loadJobHistory();
     });
     socket.on('extraction_complete', (data) => {
         hideCalculatingModal();
@@ -142,24 +235,266 @@ $(function () {
         showCalculatingModal();
         setUiState('running', config.backupSubdirs ? 'Backing up Subdirectories' : 'Backing up');
 
-        if (type === 'local') {
-            fetch('/start_local_backup', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(config) });
-        } else if (type === 'download') {
-            const params = new URLSearchParams();
-            for (const key in config) {
-                if (key === 'sources') {
-                    config.sources.forEach(source => params.append('source', source));
-                } else {
-                    params.append(key, config[key]);
-                }
+        withSelection(config).then(config => {
+            if (type === 'local') {
+                fetch('/start_local_backup', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(config) });
+            } else if (type === 'download') {
+                const params = new URLSearchParams();
+                for (const key in config) params.append(key, config[key]);
+                window.location.href = `/download_backup?${params.toString()}`;
+                setTimeout(() => {
+                    logToScreen("Download initiated. Server is preparing the file...", "info");
+                    hideCalculatingModal();
+                    setUiState('idle', 'Idle');
+                }, 5000);
             }
-            window.location.href = `/download_backup?${params.toString()}`;
-            setTimeout(() => {
-                logToScreen("Download initiated. Server is preparing the file...", "info");
-                hideCalculatingModal();
-                setUiState('idle', 'Idle');
-            }, 5000);
+        }).catch(error => {
+            logToScreen(`Could not start backup: ${error.message || error}`, 'error');
+            hideCalculatingModal(); setUiState('idle', 'Idle');
+        });
+    }
+
+    function searchFiles() {
+        const query = $('#file-search-input').val().trim();
+        if (!query) { $('#file-search-results').empty(); updateSearchStatus(); return; }
+        fetch(`/api/search_files?q=${encodeURIComponent(query)}`)
+            .then(response => response.json())
+            .then(data => {
+                const list = $('#file-search-results').empty();
+                data.results.forEach(item => {
+                    const checkbox = $('<input type="checkbox">').val(item.path).prop('checked', searchSelections.has(item.path));
+                    const icon = $('<i></i>').addClass(item.is_dir ? 'fa fa-folder' : 'fa fa-file');
+                    const size = $('<span class="size"></span>').text(item.is_dir ? '' : formatBytes(item.size));
+                    list.append($('<li></li>').append(checkbox, icon, $('<span class="path"></span>').text(item.path).attr('title', item.path), size));
+                });
+                updateSearchStatus(`${data.results.length} matches in ${data.ms} ms (${data.indexed} names indexed${data.refreshing ? ', index updating' : ''}).`);
+            })
+            .catch(error => logToScreen(`Search failed: ${error}`, 'error'));
+    }
+
+    function updateSearchStatus(summary) {
+        const status = $('#file-search-status');
+        if (summary !== undefined) status.data('summary', summary);
+        const extra = searchSelections.size ? ` ${searchSelections.size} item(s) selected outside the tree (search or profile).` : '';
+        status.text(`${status.data('summary') || ''}${extra}`);
+    }
+
+    function searchVersions() {
+        const query = $('#version-search-input').val().trim();
+        const container = $('#version-results').empty();
+        if (query.length < 2) return;
+        fetch(`/api/file_versions?q=${encodeURIComponent(query)}`)
+            .then(response => response.json())
+            .then(files => {
+                if (files.error) { container.text(files.error); return; }
+                if (files.length === 0) { container.text('No backed-up file matches.'); return; }
+                files.forEach(file => {
+                    const block = $('<div class="version-file"></div>').append($('<div class="path"></div>').text(file.path));
+                    file.versions.forEach(version => {
+                        // Restore from the newest local archive that holds this version.
+                        const source = [...version.archives].reverse().find(archive => archive.local);
+                        const modified = new Date(version.mtime * 1000).toLocaleString();
+                        const names = version.archives.map(archive => archive.name).join(', ');
+                        const row = $('<div class="version-row"></div>').append(
+                            $('<span></span>').text(`${formatBytes(version.size)}, modified ${modified}`),
+                            $('<span></span>').text(`in ${version.archives.length} backup(s)`).attr('title', names));
+                        if (source) row.append($('<button class="restore-version-btn" title="Restore this version"><i class="fas fa-undo"></i></button>').data({ archive: source.name, rel: file.rel }));
+                        block.append(row);
+                    });
+                    container.append(block);
+                });
+            })
+            .catch(error => logToScreen(`Version search failed: ${error}`, 'error'));
+    }
+
+    function restoreVersion() {
+        if (isJobRunning) return;
+        const { archive, rel } = $(this).data();
+        const config = { archive: archive, rel: rel, inPlace: $('#restore-in-place').is(':checked'), showFileProgress: false };
+        setUiState('running', 'Restoring File');
+        fetch('/api/restore_file', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(config) })
+            .then(response => response.json())
+            .then(data => { if (data.error) { logToScreen(data.error, 'error'); setUiState('idle', 'Error'); } })
+            .catch(error => { logToScreen(`File restore failed: ${error}`, 'error'); setUiState('idle', 'Error'); });
+    }
+
+    // The selection is posted once and replaced by a token, so huge selections never end up in a URL.
+    // The tree as include/exclude lists: a partly checked folder whose children are mostly checked is sent as
+    // the folder minus its unchecked children, and the reverse; the server's trie normalizes the result.
+    function treeSelection() {
+        const tree = elements.fileTree.jstree(true), include = [], exclude = [];
+        const stateOf = node => node.state.selected ? 'all' : (tree.is_undetermined(node) ? 'some' : 'none');
+        (function walk(node, included) {
+            node.children.forEach(id => {
+                const child = tree.get_node(id), state = stateOf(child);
+                if (state === 'all') { if (!included) include.push(id); return; }
+                if (state === 'none') { if (included) exclude.push(id); return; }
+                const kids = child.children.map(kid => stateOf(tree.get_node(kid)));
+                const asFolder = kids.filter(s => s === 'none').length < kids.filter(s => s === 'all').length;
+                if (asFolder && !included) include.push(id);
+                if (!asFolder && included) exclude.push(id);
+                walk(child, asFolder);
+            });
+        })(tree.get_node('#'), false);
+        return { include: [...include, ...searchSelections], exclude };
+    }
+
+    function withSelection(config) {
+        if (!config.sources.length) return Promise.resolve(config);
+        return fetch('/api/selection', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(treeSelection()) })
+            .then(response => response.json())
+            .then(data => {
+                if (data.error) throw new Error(data.error);
+                const { sources, ...rest } = config;
+                return { ...rest, selection: data.token };
+            });
+    }
+
+    function planBackup() {
+        if (isJobRunning) return;
+        const config = getBackupConfig();
+        if (config.sources.length === 0) { alert("Please select one or more source files/folders."); return; }
+        logToScreen('Planning backup (walking sources and sampling data)...', 'info');
+        withSelection(config)
+            .then(config => fetch('/api/plan_backup', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(config) }))
+            .then(response => response.json())
+            .then(plan => {
+                if (plan.error) { logToScreen(`Plan failed: ${plan.error}`, 'error'); return; }
+                logPlan(plan);
+            })
+            .catch(error => logToScreen(`Plan failed: ${error}`, 'error'));
+    }
+
+    function logPlan(plan) {
+        logToScreen(`Plan: ${plan.files} files in ${plan.dirs} folders, ${formatBytes(plan.bytes)}. Excluded: ${plan.excluded_files} files, ${formatBytes(plan.excluded_bytes)}.`, 'info');
+        const links = Object.entries(plan.symlinks || {});
+        if (links.length) {
+            const labels = { stored: 'kept as links', outside: 'kept (target outside the selection)', duplicate: 'kept (target archived at its real path)',
+                             loop: 'kept (loop)', dangling: 'dangling', followed: 'followed' };
+            logToScreen(`Symlinks: ${links.map(([reason, count]) => `${count} ${labels[reason] || reason}`).join(', ')}.`, 'info');
         }
+        const size = plan.predicted_bytes === null ? 'unknown' : `${formatBytes(plan.predicted_bytes)} (ratio ${plan.ratio} at level ${plan.level}, from ${formatBytes(plan.sampled_bytes)} sampled)`;
+        logToScreen(`Predicted archive size: ${size}. Free space: ${formatBytes(plan.free_bytes)}.`, plan.fits ? 'info' : 'warn');
+        if (plan.curve.length) logToScreen(`Level curve: ${plan.curve.map(p => `L${p.level} ${Math.round(p.ratio * 100)}% @ ${p.mb_s} MB/s`).join(', ')}.`, 'info');
+        if (plan.incompressible) logToScreen('Sampled data barely compresses; level 1 will be about as small and much faster.', 'warn');
+        const duration = plan.predicted_seconds === null ? 'unknown (no backup history yet)' : `${formatDuration(plan.predicted_seconds)} at ${formatBytes(plan.throughput)}/s`;
+        logToScreen(`Predicted duration: ${duration}. Planned in ${plan.plan_seconds}s.`, 'info');
+    }
+
+    function loadJobHistory() {
+        fetch('/api/job_history').then(response => response.json()).then(data => {
+            if (data.error) return;
+            jobHistory = data.jobs;
+            const select = $('#history-profile'), current = select.val();
+            const profiles = [...new Set(jobHistory.map(job => job.profile || ''))].filter(Boolean).sort();
+            select.html('<option value="">All jobs</option><option value="-">Manual jobs</option>'
+                + profiles.map(name => `<option value="${$('<span>').text(name).html()}">${$('<span>').text(name).html()}</option>`).join(''));
+            select.val(current || ''); drawJobHistory();
+        }).catch(() => {});
+    }
+
+    function drawJobHistory() {
+        // One dot per successful run, oldest left; failed runs are red, the dashed line is the median.
+        const canvas = $('#history-chart')[0], metric = $('#history-metric').val(), profile = $('#history-profile').val();
+        const label = $('#history-metric option:selected').text();
+        const jobs = jobHistory.filter(job => job[metric] !== null && job[metric] !== undefined
+            && (profile === '' || (profile === '-' ? !job.profile : job.profile === profile)));
+        const ctx = canvas.getContext('2d'), width = canvas.width = canvas.clientWidth, height = canvas.height;
+        ctx.clearRect(0, 0, width, height);
+        if (!jobs.length) { $('#history-summary').text('No finished backups with this metric yet.'); return; }
+        const values = jobs.map(job => job[metric]), max = Math.max(...values) * 1.1 || 1, pad = 24;
+        const x = i => pad + (jobs.length > 1 ? i * (width - 2 * pad) / (jobs.length - 1) : (width - 2 * pad) / 2);
+        const y = v => height - pad - v / max * (height - 2 * pad);
+        const ok = values.filter((_, i) => jobs[i].status === 'success').sort((a, b) => a - b);
+        const median = ok.length ? ok[Math.floor(ok.length / 2)] : null;
+        ctx.strokeStyle = '#40444b'; ctx.beginPath(); ctx.moveTo(pad, height - pad); ctx.lineTo(width - pad, height - pad); ctx.stroke();
+        ctx.fillStyle = '#adb5bd'; ctx.font = '11px sans-serif'; ctx.fillText(formatMetric(metric, max / 1.1), 2, pad - 8);
+        if (median !== null) {
+            ctx.setLineDash([4, 4]); ctx.strokeStyle = '#faa61a'; ctx.beginPath(); ctx.moveTo(pad, y(median)); ctx.lineTo(width - pad, y(median)); ctx.stroke(); ctx.setLineDash([]);
+        }
+        ctx.strokeStyle = '#17a2b8'; ctx.beginPath();
+        jobs.forEach((job, i) => { if (i) ctx.lineTo(x(i), y(job[metric])); else ctx.moveTo(x(i), y(job[metric])); });
+        ctx.stroke();
+        jobs.forEach((job, i) => {
+            ctx.fillStyle = job.status === 'success' ? '#43b581' : '#ed4245';
+            ctx.beginPath(); ctx.arc(x(i), y(job[metric]), 3, 0, 2 * Math.PI); ctx.fill();
+        });
+        const last = jobs[jobs.length - 1], previous = jobs.slice(0, -1).filter(job => job.status === 'success').map(job => job[metric]).sort((a, b) => a - b);
+        const baseline = previous.length ? previous[Math.floor(previous.length / 2)] : null;
+        const change = baseline ? ` (${((last[metric] / baseline - 1) * 100).toFixed(0)}% vs median of ${previous.length} earlier runs)` : '';
+        $('#history-summary').text(`${label}: last ${formatMetric(metric, last[metric])}${change}, level ${last.level}, ${new Date(last.started * 1000).toLocaleString()}.`);
+    }
+
+    function formatMetric(metric, value) {
+        if (metric === 'ratio' || metric === 'blocked') return `${(value * 100).toFixed(1)}%`;
+        if (metric === 'rss_kb') return formatBytes(value * 1024);
+        return value >= 100 ? value.toFixed(0) : value.toFixed(2);
+    }
+
+    function loadProfiles() {
+        fetch('/api/profiles').then(response => response.json()).then(data => {
+            savedProfiles = data.profiles; warmPlans = data.plans;
+            const select = $('#profile-select'), current = select.val();
+            select.empty();
+            const names = Object.keys(savedProfiles).sort();
+            if (names.length === 0) select.append('<option value="">(no saved profiles)</option>');
+            names.forEach(name => select.append($('<option></option>').val(name).text(savedProfiles[name].schedule ? `${name} (daily ${savedProfiles[name].schedule})` : name)));
+            if (current && savedProfiles[current]) select.val(current);
+            $('#profile-schedule').val((savedProfiles[select.val()] || {}).schedule || '');
+        }).catch(error => logToScreen(`Error fetching profiles: ${error}`, 'error'));
+    }
+
+    function applyProfile() {
+        const name = $('#profile-select').val(), profile = savedProfiles[name];
+        if (!profile) return;
+        elements.encryptionMethod.val(profile.encryptionMethod || 'none').trigger('change');
+        $('#gpgRecipient').val(profile.gpgRecipient || '');
+        $('#error-handling').val(profile.errorHandling || 'ignore');
+        $('#backup-type').val(profile.backupType || 'full');
+        $('#compression-level').val(profile.compressionLevel || '3');
+        $('#symlink-policy').val(profile.symlinkPolicy || 'within');
+        $('#cache-mode').val(profile.cacheMode || 'bounded');
+        $('#durability-mode').val(profile.durabilityMode || 'batch');
+        $('#excludes').val(profile.excludes || '');
+        $('#snapshot-mode').prop('checked', !!profile.snapshotMode);
+        $('#sqlite-backup').prop('checked', !!profile.sqliteBackup);
+        ['s3Prefix', 'sftpTarget', 'sftpPort', 'peerAddress'].forEach(id => $(`#${id}`).val(profile[id] || ''));
+        elements.destination.val(profile.destination || 'local').trigger('change');
+        // Sources may sit in folders the tree has not loaded, so they ride along like search picks.
+        elements.fileTree.jstree(true).deselect_all();
+        searchSelections.clear(); (profile.sources || []).forEach(path => searchSelections.add(path));
+        updateSearchStatus();
+        logToScreen(`Loaded profile '${name}' (${profile.sources.length} source(s)).`, 'info');
+        if (warmPlans[name]) logPlan(warmPlans[name]);
+    }
+
+    function saveProfile() {
+        const name = prompt('Profile name:', $('#profile-select').val() || '');
+        if (!name) return;
+        const config = { ...getBackupConfig(), name: name, schedule: $('#profile-schedule').val().trim() };
+        fetch('/api/profiles', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(config) })
+            .then(response => response.json())
+            .then(data => { logToScreen(data.error || data.status, data.error ? 'error' : 'success'); loadProfiles(); $('#profile-select').val(name); })
+            .catch(error => logToScreen(`Failed to save profile: ${error}`, 'error'));
+    }
+
+    function runProfile() {
+        const name = $('#profile-select').val();
+        if (!name || isJobRunning) return;
+        setUiState('running', `Running '${name}'`);
+        fetch(`/api/profiles/${encodeURIComponent(name)}/run`, { method: 'POST' })
+            .then(response => response.json())
+            .then(data => { if (data.error) { logToScreen(data.error, 'error'); setUiState('idle', 'Error'); } })
+            .catch(error => { logToScreen(`Failed to run profile: ${error}`, 'error'); setUiState('idle', 'Error'); });
+    }
+
+    function deleteProfile() {
+        const name = $('#profile-select').val();
+        if (!name || !confirm(`Delete profile '${name}'?`)) return;
+        fetch(`/api/profiles/${encodeURIComponent(name)}`, { method: 'DELETE' })
+            .then(response => response.json())
+            .then(data => { logToScreen(data.error || data.status, data.error ? 'error' : 'info'); loadProfiles(); })
+            .catch(error => logToScreen(`Failed to delete profile: ${error}`, 'error'));
     }
 
     function startLocalExtraction() {
@@ -168,7 +503,9 @@ $(function () {
         if (!filename) { alert("Please select a backup file from the list to restore."); return; }
         const config = {
             filename: filename,
-            showFileProgress: elements.showFileProgress.is(':checked')
+            showFileProgress: elements.showFileProgress.is(':checked'),
+            restoreMode: elements.deltaRestore.is(':checked') ? 'delta' : 'full',
+            durabilityMode: $('#durability-mode').val()
         };
         setUiState('running', 'Extracting');
         fetch('/start_extraction', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(config) });
@@ -182,11 +519,36 @@ $(function () {
         const formData = new FormData();
         formData.append('backupFile', fileInput.files[0]);
         formData.append('showFileProgress', elements.showFileProgress.is(':checked'));
+        formData.append('restoreMode', elements.deltaRestore.is(':checked') ? 'delta' : 'full');
+        formData.append('durabilityMode', $('#durability-mode').val());
         fetch('/upload_and_extract', { method: 'POST', body: formData })
             .then(response => { if (!response.ok) return response.json().then(err => { throw new Error(err.error || 'Upload failed') }); return response.json(); })
             .catch(error => { logToScreen(`Upload failed: ${error.message}`, 'error'); setUiState('idle', 'Error'); });
     }
 
+    function cancelJob() {
+        if (!isJobRunning) return;
+        elements.cancelJobBtn.prop('disabled', true);
+        fetch('/api/cancel_job', { method: 'POST' })
+            .then(response => response.json())
+            .then(data => logToScreen(data.status, 'warn'))
+            .catch(error => logToScreen(`Failed to cancel: ${error}`, 'error'));
+    }
+
+    function startPeerReceive() {
+        if (isJobRunning) return;
+        fetch('/api/peer/listen', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify({ showFileProgress: elements.showFileProgress.is(':checked'), targetDir: $('#peer-target-dir').val().trim() }) })
+            .then(response => response.json())
+            .then(data => {
+                if (data.error) { logToScreen(`Cannot start receive mode: ${data.error}`, 'error'); return; }
+                $('#peer-listen-address').text(data.address);
+                $('#peer-listen-token').text(data.token);
+                $('#peer-pairing-info').removeClass('hidden');
+                setUiState('running', 'Waiting for Peer');
+            })
+            .catch(error => logToScreen(`Failed to start receive mode: ${error}`, 'error'));
+    }
+
     function handleDeleteClick() {
         if (isJobRunning) return;
         const filename = $(this).data('filename');
@@ -201,6 +563,18 @@ $(function () {
         }
     }
 
+    function handlePushClick() {
+        if (isJobRunning) return;
+        const filename = $(this).data('filename');
+        const target = $('#sftpTarget').val();
+        if (!target) { alert("Set the remote directory under 'Remote Host (SFTP)' in Backup Options first."); return; }
+        setUiState('running', 'Pushing');
+        fetch('/api/push_backup', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify({ filename: filename, sftpTarget: target, sftpPort: $('#sftpPort').val() }) })
+            .then(response => response.json())
+            .then(data => { if (data.error) { logToScreen(`Push failed: ${data.error}`, 'error'); setUiState('idle', 'Error'); } })
+            .catch(error => { logToScreen(`Failed to send push request: ${error}`, 'error'); setUiState('idle', 'Error'); });
+    }
+
     function loadBackupFiles() {
         fetch('/api/list_backups').then(response => response.json()).then(data => {
             elements.backupTableBody.empty();
@@ -211,7 +585,7 @@ $(function () {
                                     <td>${backup.filename}</td>
                                     <td>${backup.size}</td>
                                     <td>${backup.modified}</td>
-                                    <td><button class="action-btn delete-btn" data-filename="${backup.filename}" title="Delete Backup"><i class="fas fa-trash-alt"></i></button></td>
+                                    <td><button class="action-btn push-btn" data-filename="${backup.filename}" title="Push to Remote (SFTP)"><i class="fas fa-server"></i></button><button class="action-btn delete-btn" data-filename="${backup.filename}" title="Delete Backup"><i class="fas fa-trash-alt"></i></button></td>
                                  </tr>`;
                     elements.backupTableBody.append(row);
                 });
@@ -224,8 +598,9 @@ $(function () {
 
     // --- Helper Functions ---
     function getBackupConfig() {
-        const selectedNodes = elements.fileTree.jstree(true).get_selected(true);
-        const sources = selectedNodes.map(node => node.id);
+        // Only the topmost checked nodes: a checked folder already covers everything below it.
+        const selectedNodes = elements.fileTree.jstree(true).get_top_selected(true);
+        const sources = [...new Set([...selectedNodes.map(node => node.id), ...searchSelections])];
         const method = elements.encryptionMethod.val();
         return {
             sources: sources,
@@ -235,7 +610,21 @@ $(function () {
             gpgRecipient: $('#gpgRecipient').val(),
             encryptionPassword: $('#encryptionPassword').val(),
             showFileProgress: elements.showFileProgress.is(':checked'),
-            backupSubdirs: elements.backupSubdirsIndividually.is(':checked')
+            backupSubdirs: elements.backupSubdirsIndividually.is(':checked'),
+            backupType: $('#backup-type').val(),
+            compressionLevel: $('#compression-level').val(),
+            symlinkPolicy: $('#symlink-policy').val(),
+            cacheMode: $('#cache-mode').val(),
+            durabilityMode: $('#durability-mode').val(),
+            excludes: $('#excludes').val(),
+            snapshotMode: $('#snapshot-mode').is(':checked'),
+            sqliteBackup: $('#sqlite-backup').is(':checked'),
+            destination: elements.destination.val(),
+            s3Prefix: $('#s3Prefix').val(),
+            sftpTarget: $('#sftpTarget').val(),
+            sftpPort: $('#sftpPort').val(),
+            peerAddress: $('#peerAddress').val(),
+            peerToken: $('#peerToken').val()
         };
     }
 
@@ -253,6 +642,7 @@ $(function () {
     function setUiState(state, statusText) {
         isJobRunning = (state === 'running');
         $('button, input').prop('disabled', isJobRunning);
+        elements.cancelJobBtn.prop('disabled', !isJobRunning);
         if (isJobRunning) {
             wakeLockManager.acquire();
             elements.logOutput.html('');
@@ -262,6 +652,7 @@ $(function () {
         } else {
             wakeLockManager.release();
             $('button, input').prop('disabled', false);
+            elements.cancelJobBtn.prop('disabled', true);
             updateStatus(statusText, 'status-idle');
         }
     }
@@ -272,6 +663,50 @@ $(function () {
         elements.logOutput.scrollTop(elements.logOutput[0].scrollHeight);
     }
 
+    function formatBytes(bytes) {
+        const units = ['B', 'KB', 'MB', 'GB', 'TB']; let i = 0;
+        while (bytes >= 1024 && i < units.length - 1) { bytes /= 1024; i++; }
+        return `${bytes.toFixed(i ? 2 : 0)} ${units[i]}`;
+    }
+
+    function fileLogLine(filename) {
+        const depth = (filename.match(/\//g) || []).length;
+        const basename = filename.substring(filename.lastIndexOf('/') + 1) || filename;
+        return `${' '.repeat(depth * 2)}✅ ${basename}\n`;
+    }
+
+    function renderProgress() {
+        // The bar follows the most recently started job; every job gets a line when several run at once.
+        const jobs = [...progressJobs.entries()].filter(([, job]) => job.record);
+        const lines = jobs.map(([, job]) => {
+            const r = job.record, percent = r.total > 0 ? Math.min(r.bytes / r.total * 100, 100) : null;
+            return `<div>${$('<span>').text(job.label).html()}: ${percent === null ? formatBytes(r.bytes) : percent.toFixed(1) + '%'}`
+                + ` · ${r.files} files · ${formatBytes(r.rate)}/s · compressor-bound ${r.blocked.toFixed(0)}%</div>`;
+        });
+        elements.progressJobs.html(jobs.length > 1 ? lines.join('') : '');
+        if (!jobs.length) return;
+        const r = jobs[jobs.length - 1][1].record;
+        const percent = r.total > 0 ? Math.min(r.bytes / r.total * 100, r.state ? 100 : 99.9).toFixed(1) : '0.0';
+        elements.progressBar.css('width', percent + '%'); elements.progressText.text(percent + '%');
+        elements.speedIndicator.html(`<i class="fas fa-bolt"></i> ${formatBytes(r.rate)}/s`);
+        elements.etaIndicator.html(`<i class="fas fa-hourglass-half"></i> ETA: ${r.eta === null ? '--:--' : formatDuration(r.eta)}`);
+    }
+
+    function formatDuration(seconds) {
+        const h = Math.floor(seconds / 3600), m = Math.floor(seconds % 3600 / 60), s = Math.round(seconds % 60);
+        return h ? `${h}h ${m}m` : (m ? `${m}m ${s}s` : `${s}s`);
+    }
+
+    function logFailureReport(report) {
+        const stages = Object.entries(report.by_stage).map(([stage, count]) => `${stage}: ${count}`).join(', ');
+        const errors = Object.entries(report.by_error).map(([error, count]) => `${error}: ${count}`).join(', ');
+        logToScreen(`${report.count} entries were skipped (${stages}; ${errors}).`, 'warn');
+        if (report.report) {
+            const link = $('<a target="_blank"></a>').attr('href', `/api/reports/${encodeURIComponent(report.report)}`).text('Open failure report');
+            elements.logOutput.append(link).append('\n');
+        }
+    }
+
     function showCalculatingModal() {
         $('.modal-content h3').text('Preparing... Calculating size...');
         elements.calculatingModal.css('display', 'flex').hide().fadeIn(200);
@@ -291,6 +726,20 @@ $(function () {
         elements.ageOptions.toggleClass('hidden', selectedMethod !== 'age');
     }
 
+    function handleDestinationChange() {
+        const destination = $(this).val();
+        const labels = {
+            local: '<i class="fas fa-save"></i> Save to Termux',
+            s3: '<i class="fas fa-cloud-upload-alt"></i> Upload to S3',
+            sftp: '<i class="fas fa-server"></i> Push to Remote',
+            peer: '<i class="fas fa-people-arrows"></i> Send to Peer'
+        };
+        elements.s3Options.toggleClass('hidden', destination !== 's3');
+        elements.sftpOptions.toggleClass('hidden', destination !== 'sftp');
+        elements.peerOptions.toggleClass('hidden', destination !== 'peer');
+        elements.startLocalBtn.html(labels[destination]);
+    }
+
     function handleFileSelectionChange(filename) {
         filename = filename || '';
         elements.ageRestoreOptions.toggleClass('hidden', !filename.endsWith('.age'));
@@ -300,9 +749,13 @@ $(function () {
     function switchRestoreTab(tabName) {
         const isLocal = tabName === 'local';
         elements.navRestoreLocal.toggleClass('active', isLocal);
-        elements.navRestoreUpload.toggleClass('active', !isLocal);
+        elements.navRestoreUpload.toggleClass('active', tabName === 'upload');
+        elements.navRestorePeer.toggleClass('active', tabName === 'peer');
+        elements.navRestoreVersions.toggleClass('active', tabName === 'versions');
         elements.restoreLocalPanel.toggleClass('hidden', !isLocal);
-        elements.restoreUploadPanel.toggleClass('hidden', isLocal);
+        elements.restoreUploadPanel.toggleClass('hidden', tabName !== 'upload');
+        elements.restorePeerPanel.toggleClass('hidden', tabName !== 'peer');
+        elements.restoreVersionsPanel.toggleClass('hidden', tabName !== 'versions');
         handleFileSelectionChange(isLocal ? $('input[name="backup-selection"]:checked').val() : elements.uploadFileInput.val());
     }
 